@@ -0,0 +1,17 @@
+#!/bin/bash
+
+# Stress input for duplicate definitions: two modules that each define the
+# same N symbols, so every definition of the second module is a duplicate.
+# The deflists exceed the default limit, link with -l<N>:
+#
+#   ./gendups.sh 100000 > dups && time ../linker -l100000 dups > /dev/null
+
+N=${1:-100000}
+
+awk -v n=${N} 'BEGIN {
+	for (m = 0; m < 2; m++) {
+		printf "%d", n
+		for (i = 0; i < n; i++) printf " S%d 0", i
+		printf "\n0\n1 I 1000\n"
+	}
+}'
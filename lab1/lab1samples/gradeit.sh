@@ -4,7 +4,7 @@ DIR1=$1
 DIR2=$2
 LOG=${3:-${DIR2}/LOG}
 
-INS="`seq 1 20`"
+INS="`seq 1 23`"
 
 OUTPRE="out-"
 INPRE="input-"
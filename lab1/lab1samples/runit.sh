@@ -8,7 +8,7 @@ LINKER=${*:-../linker}
 
 echo "linker=<$LINKER> outdir=<$OUTDIR>"
 
-INS="`seq 1 20`" 
+INS="`seq 1 23`" 
 INPRE="input-"
 OUTPRE="out-"
 
@@ -89,8 +89,21 @@ trap GetMeOutOfHere SIGINT
 #ulimit -v 300000   # just limit the processes 
 
 for f in ${INS}; do
-	echo "${LINKER} ${INPRE}${f}"
-	${LINKER} ${INPRE}${f} > ${OUTDIR}/${OUTPRE}${f} 2>&1 &
+	ARGS="${INPRE}${f}"
+	case ${f} in
+	21)	# relink from the cache of input-21a, edited twice
+		rm -f ${OUTDIR}/cache-21
+		${LINKER} -i${OUTDIR}/cache-21 ${INPRE}21a > /dev/null 2>&1
+		${LINKER} -i${OUTDIR}/cache-21 ${INPRE}21b > /dev/null 2>&1
+		ARGS="-i${OUTDIR}/cache-21 ${INPRE}21" ;;
+	22)	# only the member defining sqrt and out is pulled in
+		ARGS="${INPRE}22 archive-22" ;;
+	23)	# the image is dumped after the output, see below
+		rm -f ${OUTDIR}/image-23
+		ARGS="-o${OUTDIR}/image-23 ${INPRE}23" ;;
+	esac
+	echo "${LINKER} ${ARGS}"
+	${LINKER} ${ARGS} > ${OUTDIR}/${OUTPRE}${f} 2>&1 &
 	#${LINKER} ${INPRE}${f} > ${OUTDIR}/${OUTPRE}${f} &
 	SPID=$!
 
@@ -101,6 +114,7 @@ for f in ${INS}; do
 
 	TimerOff; stop_redirect
 	[[ ${SPID_KILLED} == 1 ]] && echo "      Killed after ${TIMELIMIT}"
+	[[ ${f} == 23 ]] && od -A x -t x1 -v ${OUTDIR}/image-23 >> ${OUTDIR}/${OUTPRE}${f} 2>&1
 	check_exit
 done
 
@@ -1,13 +1,22 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
-#include <sstream>
 #include <string>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
 #include <vector>
 #include <utility>
 #include <algorithm>
-#include <unordered_map>
-#include <unordered_set>
+#include <atomic>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -23,39 +32,192 @@ private:
         TOO_MANY_INSTR
     };
     
+    /// A token in the mapped input, in place of C++17's `string_view`
+    class Token {
+    private:
+        const char* data_;
+        size_t size_;
+    public:
+        Token() : data_(nullptr), size_(0) {}
+        Token(const char* data, size_t size) : data_(data), size_(size) {}
+        
+        const char* begin() const { return data_; }
+        const char* end() const { return data_ + size_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        char operator[](size_t i) const { return data_[i]; }
+        
+        bool operator==(const char* s) const {
+            return strlen(s) == size_ && equal(begin(), end(), s);
+        }
+        
+        string str() const { return string(data_, size_); }
+        
+        friend ostream& operator<<(ostream& os, const Token& token) {
+            return os.write(token.data_, token.size_);
+        }
+    };
+    
+    /**
+     * Symbol names interned to dense ids, the names stored back to back in
+     * one arena. Ids index the per-symbol tables of the linker.
+     */
+    class Symbols {
+    private:
+        string arena_;
+        vector<unsigned int> start_;    /// arena offset of each name, and one past the last
+        vector<int> slots_;             /// open addressing by name hash, -1 if empty
+        
+        static size_t hash(const Token& name) {
+            size_t h = 2166136261u;
+            for (char c : name) {
+                h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+            }
+            return h;
+        }
+        
+        void grow() {
+            vector<int> slots(slots_.empty() ? 1024 : 2*slots_.size(), -1);
+            for (int id = 0; id < size(); id++) {
+                size_t i = hash(name(id)) & (slots.size()-1);
+                while (slots[i] >= 0) {
+                    i = (i+1) & (slots.size()-1);
+                }
+                slots[i] = id;
+            }
+            slots_.swap(slots);
+        }
+        
+        /// @return the slot holding `name`, or the empty slot it would take
+        size_t probe(const Token& name) const {
+            size_t i = hash(name) & (slots_.size()-1);
+            for (; slots_[i] >= 0; i = (i+1) & (slots_.size()-1)) {
+                Token known = this->name(slots_[i]);
+                if (known.size() == name.size() && equal(name.begin(), name.end(), known.begin())) {
+                    break;
+                }
+            }
+            return i;
+        }
+    public:
+        Symbols() : start_(1, 0) {}
+        
+        int size() const {
+            return static_cast<int>(start_.size()) - 1;
+        }
+        
+        /// Valid until the next `intern`
+        Token name(int id) const {
+            return Token(arena_.data() + start_[id], start_[id+1] - start_[id]);
+        }
+        
+        /// @return the id of `name`, or -1 if it was never interned
+        int find(const Token& name) const {
+            return slots_.empty() ? -1 : slots_[probe(name)];
+        }
+        
+        /// @return the id of `name`, a new one the first time it is seen
+        int intern(const Token& name) {
+            if (2*static_cast<size_t>(size()+1) > slots_.size()) {
+                grow();
+            }
+            size_t i = probe(name);
+            if (slots_[i] >= 0) {
+                return slots_[i];
+            }
+            slots_[i] = size();
+            arena_.append(name.begin(), name.size());
+            start_.push_back(static_cast<unsigned int>(arena_.size()));
+            return slots_[i];
+        }
+    };
+    
+    /// A whole file mapped read-only; one that cannot be read maps empty
+    class MappedFile {
+    private:
+        const char* data_;
+        size_t size_;
+    public:
+        MappedFile(const string& path) : data_(nullptr), size_(0) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    data_ = static_cast<const char*>(addr);
+                    size_ = st.st_size;
+                }
+            }
+            close(fd);
+        }
+        
+        ~MappedFile() {
+            if (data_) {
+                munmap(const_cast<char*>(data_), size_);
+            }
+        }
+        
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+    };
+    
+    /**
+     * Tokens are maximal runs of non-space characters in the input, mapped
+     * read-only. The position of the current token is tracked as the input is
+     * scanned: `linenum_` counts the lines reached and `lineoffset_` is the
+     * 1-based column of the token, or one past the last line at the end.
+     */
     class Tokenizer {
     private:
-        ifstream ifs_;
-        istringstream iss_;
-        string token_;
-        int linenum_, lineoffset_, finalpos_;
-        
-        bool loadline() {
-            string line;
-            if (getline(ifs_, line)) {
-                finalpos_ = static_cast<int>(line.size()) + 1;
-                iss_.clear();
-                iss_.str(line + " ");
-                linenum_++;
-                return true;
+        MappedFile file_;
+        const char* data_;
+        size_t size_, pos_;
+        size_t linestart_, prevlinestart_;
+        Token token_;
+        int linenum_, lineoffset_;
+        
+        void skip_space() {
+            while (pos_ < size_ && isspace(static_cast<unsigned char>(data_[pos_]))) {
+                if (data_[pos_] == '\n') {
+                    linenum_++;
+                    prevlinestart_ = linestart_;
+                    linestart_ = pos_ + 1;
+                }
+                pos_++;
             }
-            return false;
         }
         
         bool getToken() {
-            while (!(iss_ >> token_)) {
-                if (!loadline()) {
-                    lineoffset_ = finalpos_;
-                    return false;
+            skip_space();
+            if (pos_ == size_) {
+                // a final newline does not start another line
+                if (linestart_ == size_ && linenum_ > 1) {
+                    linenum_--;
+                    linestart_ = prevlinestart_;
+                    lineoffset_ = static_cast<int>(size_ - 1 - linestart_) + 1;
                 }
+                else {
+                    lineoffset_ = static_cast<int>(size_ - linestart_) + 1;
+                }
+                return false;
             }
-            lineoffset_ = static_cast<int>(iss_.tellg()) - static_cast<int>(token_.size()) + 1;
+            size_t start = pos_;
+            while (pos_ < size_ && !isspace(static_cast<unsigned char>(data_[pos_]))) {
+                pos_++;
+            }
+            token_ = Token(data_ + start, pos_ - start);
+            lineoffset_ = static_cast<int>(start - linestart_) + 1;
             return true;
         }
     public:
-        Tokenizer(const string infile) : linenum_(0) {
-            ifs_.open(infile);
-        }
+        // an input that cannot be read has no tokens
+        Tokenizer(const string infile) :
+        file_(infile), data_(file_.data()), size_(file_.size()), pos_(0),
+        linestart_(0), prevlinestart_(0), linenum_(1) {}
         
         template<class InputIterator, class UnaryPredicate>
         static bool all_of (InputIterator first, InputIterator last, UnaryPredicate pred) {
@@ -66,44 +228,61 @@ private:
             return true;
         }
         
-        static bool isnum(const string& token) {
+        static bool isnum(const Token& token) {
             return !token.empty()
             && all_of(token.begin(), token.end(), ::isdigit);
         }
         
         // only test [a-Z][a-Z0-9]*, doesn't test length
-        static bool issymbol(const string& token) {
+        static bool issymbol(const Token& token) {
             return !token.empty()
             && isalpha(token[0])
             && all_of(token.begin()+1, token.end(), ::isalnum);
         }
         
-        static bool isIAER(const string& token) {
+        static bool isIAER(const Token& token) {
             return token=="I" || token=="A" || token=="E" || token=="R";
         }
         
         bool eof() {
-            auto offset = iss_.tellg();
-            if (iss_ >> token_) {
-                iss_.seekg(offset);
-                return false;
-            }
-            offset = ifs_.tellg();
-            if (ifs_ >> token_) {
-                ifs_.seekg(offset);
-                return false;
+            skip_space();
+            return pos_ == size_;
+        }
+        
+        /// Read `magic` if it is the next token
+        bool read_magic(const char* magic) {
+            size_t pos = pos_;
+            int linenum = linenum_;
+            size_t linestart = linestart_, prevlinestart = prevlinestart_;
+            if (getToken() && token_ == magic) {
+                return true;
             }
-            return true;
+            pos_ = pos;
+            linenum_ = linenum;
+            linestart_ = linestart;
+            prevlinestart_ = prevlinestart;
+            return false;
         }
         
+        int linenum() const { return linenum_; }
+        int lineoffset() const { return lineoffset_; }
+        
         int read_int() {
             if (!getToken() || !isnum(token_)) {
                 throw PARSE_ERROR::NUM_EXPECTED;
             }
-            return stoi(token_);
+            // as stoi would
+            long value = 0;
+            for (char c : token_) {
+                value = value*10 + (c - '0');
+                if (value > INT_MAX) {
+                    throw out_of_range("stoi");
+                }
+            }
+            return static_cast<int>(value);
         }
         
-        string read_symbol() {
+        Token read_symbol() {
             if (!getToken() || !issymbol(token_)) {
                 throw PARSE_ERROR::SYM_EXPECTED;
             }
@@ -113,14 +292,14 @@ private:
             return token_;
         }
         
-        string read_IAER() {
+        Token read_IAER() {
             if (!getToken() || !isIAER(token_)) {
                 throw PARSE_ERROR::ADDR_EXPECTED;
             }
             return token_;
         }
         
-        void parseerror(int errcode) {
+        static void parseerror(int errcode, int linenum, int lineoffset) {
             vector<string> errstr {
                 "NUM_EXPECTED",
                 "SYM_EXPECTED",
@@ -130,238 +309,1043 @@ private:
                 "TOO_MANY_USE_IN_MODULE",
                 "TOO_MANY_INSTR"
             };
-            cout << "Parse Error line " << linenum_ << " offset " << lineoffset_ << ": " << errstr[errcode] << endl;
+            cout << "Parse Error line " << linenum << " offset " << lineoffset << ": " << errstr[errcode] << endl;
         }
     };
     
-    const string infile_;
-    unordered_map<string, int> symbol_table_;
+    // errors of a relocated word; their arguments are found again in the IR
+    enum INSTR_ERROR : unsigned char {
+        NO_ERROR,
+        ILLEGAL_IMMEDIATE,
+        ILLEGAL_OPCODE,
+        REL_EXCEEDS_MODULE,
+        EXT_EXCEEDS_USELIST,
+        SYM_NOT_DEFINED,
+        ABS_EXCEEDS_MACHINE
+    };
+    
+    // program text of all modules, kept from pass1 for relocation
+    struct Instruction {
+        char type;  /// I, A, E or R
+        int instr;
+    };
+    
+    struct Module {
+        int base;                           /// absolute address of its first instruction
+        int codecount;
+        vector<pair<int, int>> deflist;     /// symbol id, relative address
+        vector<int> uselist;
+    };
+    
+    /**
+     * One input file, tokenized on its own so that files can be read in
+     * parallel. Its modules are placed in the link afterwards, in input order.
+     * An archive starts with `!<arch>` followed by modules; each module is a
+     * member that is linked only if it defines a symbol still undefined.
+     */
+    struct Unit {
+        string path;
+        bool archive;
+        Symbols symbols;                /// ids of `modules`
+        vector<Module> modules;         /// `base` indexes `program`
+        vector<pair<int, int>> counts;  /// line and offset of each code count
+        vector<Instruction> program;
+        size_t complete;                /// modules read to the end; one more is partial
+        bool failed, overflow;          /// a parse error at `linenum`/`lineoffset`, or stoi's
+        PARSE_ERROR errcode;
+        int linenum, lineoffset;
+        
+        Unit() : archive(false), complete(0), failed(false), overflow(false),
+        errcode(NUM_EXPECTED), linenum(0), lineoffset(0) {}
+    };
+    
+    const vector<string> inputs_;
+    const int machine_size_, list_size_;
+    const int radix_;       /// 10^operand digits, splits opcode from operand
+    const int addr_width_;  /// digits of the highest address, at least 3
+    static const int UNDEFINED = -1;
+    Symbols symbols_;
+    vector<int> symbol_table_;  /// by symbol id, UNDEFINED if not defined
+    vector<bool> mutiple_defined_;
+    vector<bool> referenced_;   /// in the uselist of a linked module
+    vector<int> first_defs_;    /// first definitions, in order
     vector<int> memory_map_;
+    vector<Module> modules_;
+    vector<Instruction> program_;
     
-    void print_symbol_table(vector<string>& deflist, unordered_map<string, bool> md) {
+    void print_symbol_table(const vector<int>& deflist, const vector<bool>& md) {
         cout << "Symbol Table" << endl;
-        for (string& symbol : deflist) {
-            cout << symbol << "=" << symbol_table_[symbol];
+        for (int symbol : deflist) {
+            cout << symbols_.name(symbol) << "=" << symbol_table_[symbol];
             if (md[symbol]) {
                 cout << " Error: This variable is multiple times defined; first value used";
             }
-            cout << endl;
+            cout << '\n';
         }
         cout << endl;
     }
     
-    void print_memory_map(vector<string>& instrerr, vector<pair<int, string>>& moderr) {
+    void print_instr_error(const Module& mod, int addr, INSTR_ERROR errcode) {
+        switch (errcode) {
+            case NO_ERROR:
+                break;
+            case ILLEGAL_IMMEDIATE:
+                cout << " Error: Illegal immediate value; treated as " << 10*radix_ - 1;
+                break;
+            case ILLEGAL_OPCODE:
+                cout << " Error: Illegal opcode; treated as " << 10*radix_ - 1;
+                break;
+            case REL_EXCEEDS_MODULE:
+                cout << " Error: Relative address exceeds module size; zero used";
+                break;
+            case EXT_EXCEEDS_USELIST:
+                cout << " Error: External address exceeds length of uselist; treated as immediate";
+                break;
+            case SYM_NOT_DEFINED:
+                cout << " Error: " << symbols_.name(mod.uselist[program_[addr].instr % radix_])
+                     << " is not defined; zero used";
+                break;
+            case ABS_EXCEEDS_MACHINE:
+                cout << " Error: Absolute address exceeds machine size; zero used";
+                break;
+        }
+    }
+    
+    /**
+     * @param instrerr error of each word
+     * @param usage which uselist entries each module used
+     */
+    void print_memory_map(const vector<INSTR_ERROR>& instrerr, const vector<vector<bool>>& usage) {
         cout << "Memory Map" << endl;
-        int p = 0;
-        for (int i = 0; i < memory_map_.size(); i++) {
-            while (p < moderr.size() && i == moderr[p].first) {
-                cout << moderr[p].second;
-                p++;
+        for (size_t m = 0; m < modules_.size(); m++) {
+            const Module& mod = modules_[m];
+            for (int i = mod.base; i < mod.base + mod.codecount; i++) {
+                cout << setw(addr_width_) << setfill('0') << i;
+                cout << ": " << setw(digits(radix_)) << setfill('0') << memory_map_[i];
+                print_instr_error(mod, i, instrerr[i]);
+                cout << '\n';
             }
-            cout << setw(3) << setfill('0') << i;
-            cout << ": " << setw(4) << setfill('0') << memory_map_[i];
-            cout << instrerr[i] << endl;
-        }
-        while (p < moderr.size()) {
-            cout << moderr[p].second;
-            p++;
+            print_uselist_warnings(m, usage[m]);
         }
         cout << endl;
     }
     
+    /// Appeared in uselist but not actually used
+    void print_uselist_warnings(size_t m, const vector<bool>& uselist_usage) {
+        const Module& mod = modules_[m];
+        for (size_t i = 0; i < mod.uselist.size(); i++) {
+            if (!uselist_usage[i]) {
+                cout << "Warning: Module " << m+1 << ": " << symbols_.name(mod.uselist[i])
+                     << " appeared in the uselist but was not actually used\n";
+            }
+        }
+    }
+    
+    // state of a previous link, kept for incremental relinking
+    struct Cache {
+        Symbols symbols;
+        vector<int> symbol_table;
+        vector<Module> modules;         /// symbol ids are ids of `symbols`
+        vector<Instruction> program;
+        vector<int> memory_map;
+        vector<INSTR_ERROR> instrerr;
+        vector<vector<bool>> usage;
+    };
+    
+    static constexpr const char* CACHE_MAGIC = "LNKCACHE";
+    static const int CACHE_VERSION = 1;
+    
+    /// Bounds-checked reads from a mapped cache; reading past its end fails
+    class CacheReader {
+    private:
+        const char* pos_;
+        const char* end_;
+        bool ok_;
+    public:
+        CacheReader(const MappedFile& file) :
+        pos_(file.data()), end_(file.data() + file.size()), ok_(file.size() > 0) {}
+        
+        bool ok() const { return ok_; }
+        bool at_end() const { return pos_ == end_; }
+        
+        /// @return the next `count` bytes, null if there are fewer
+        const char* take(size_t count) {
+            if (!ok_ || static_cast<size_t>(end_ - pos_) < count) {
+                ok_ = false;
+                return nullptr;
+            }
+            const char* data = pos_;
+            pos_ += count;
+            return data;
+        }
+        
+        template <typename T>
+        T get() {
+            T value = T();
+            const char* data = take(sizeof(T));
+            if (data) {
+                memcpy(&value, data, sizeof(T));
+            }
+            return value;
+        }
+        
+        template <typename T>
+        void get(vector<T>& values, size_t count) {
+            values.clear();
+            if (count > static_cast<size_t>(end_ - pos_) / sizeof(T)) {
+                ok_ = false;
+            }
+            const char* data = take(count * sizeof(T));
+            if (data && count > 0) {
+                values.resize(count);
+                memcpy(values.data(), data, count * sizeof(T));
+            }
+        }
+    };
+    
+    template <typename T>
+    static void put(ostream& os, const T& value) {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    
+    template <typename T>
+    static void put(ostream& os, const vector<T>& values) {
+        os.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+    
+    /**
+     * Write what an incremental relink needs to `path`, through a temporary
+     * file so an interrupted write leaves the previous cache in place
+     */
+    void save_cache(const string& path, const vector<INSTR_ERROR>& instrerr,
+                    const vector<vector<bool>>& usage) {
+        const string tmp = path + ".tmp";
+        ofstream os(tmp, ios::binary | ios::trunc);
+        os.write(CACHE_MAGIC, strlen(CACHE_MAGIC));
+        put(os, CACHE_VERSION);
+        put(os, machine_size_);
+        put(os, radix_);
+        
+        put(os, static_cast<uint32_t>(symbols_.size()));
+        for (int id = 0; id < symbols_.size(); id++) {
+            Token name = symbols_.name(id);
+            put(os, static_cast<uint32_t>(name.size()));
+            os.write(name.begin(), name.size());
+        }
+        put(os, symbol_table_);
+        
+        put(os, static_cast<uint32_t>(modules_.size()));
+        for (size_t m = 0; m < modules_.size(); m++) {
+            const Module& mod = modules_[m];
+            put(os, mod.base);
+            put(os, mod.codecount);
+            put(os, static_cast<uint32_t>(mod.deflist.size()));
+            for (const pair<int, int>& def : mod.deflist) {
+                put(os, def.first);
+                put(os, def.second);
+            }
+            put(os, static_cast<uint32_t>(mod.uselist.size()));
+            put(os, mod.uselist);
+            put(os, vector<char>(usage[m].begin(), usage[m].end()));
+        }
+        
+        vector<char> types(program_.size());
+        vector<int> instrs(program_.size());
+        for (size_t i = 0; i < program_.size(); i++) {
+            types[i] = program_[i].type;
+            instrs[i] = program_[i].instr;
+        }
+        put(os, static_cast<uint32_t>(program_.size()));
+        put(os, types);
+        put(os, instrs);
+        put(os, memory_map_);
+        put(os, instrerr);
+        
+        os.close();
+        if (!os || rename(tmp.c_str(), path.c_str()) != 0) {
+            cerr << "Cannot write cache " << path << "." << endl;
+            remove(tmp.c_str());
+        }
+    }
+    
+    /**
+     * Read the cache of the previous link from `path`. A cache of another
+     * machine size or operand width cannot be reused.
+     *
+     * @return false if there is no usable cache
+     */
+    bool load_cache(const string& path, Cache& old) {
+        MappedFile file(path);
+        if (file.size() == 0) {
+            return false;
+        }
+        CacheReader in(file);
+        const char* magic = in.take(strlen(CACHE_MAGIC));
+        if (!magic || memcmp(magic, CACHE_MAGIC, strlen(CACHE_MAGIC)) != 0
+            || in.get<int>() != CACHE_VERSION) {
+            cerr << "Ignoring cache " << path << " of another format." << endl;
+            return false;
+        }
+        if (in.get<int>() != machine_size_ || in.get<int>() != radix_) {
+            return false;
+        }
+        
+        uint32_t nsymbols = in.get<uint32_t>();
+        for (uint32_t id = 0; in.ok() && id < nsymbols; id++) {
+            uint32_t size = in.get<uint32_t>();
+            const char* name = in.take(size);
+            if (name) {
+                old.symbols.intern(Token(name, size));
+            }
+        }
+        in.get(old.symbol_table, nsymbols);
+        
+        uint32_t nmodules = in.get<uint32_t>();
+        for (uint32_t m = 0; in.ok() && m < nmodules; m++) {
+            old.modules.push_back(Module());
+            Module& mod = old.modules.back();
+            mod.base = in.get<int>();
+            mod.codecount = in.get<int>();
+            uint32_t ndefs = in.get<uint32_t>();
+            for (uint32_t i = 0; in.ok() && i < ndefs; i++) {
+                int symbol = in.get<int>();
+                mod.deflist.push_back(make_pair(symbol, in.get<int>()));
+            }
+            uint32_t nuses = in.get<uint32_t>();
+            in.get(mod.uselist, nuses);
+            vector<char> used;
+            in.get(used, nuses);
+            old.usage.push_back(vector<bool>(used.begin(), used.end()));
+        }
+        
+        uint32_t ninstrs = in.get<uint32_t>();
+        vector<char> types;
+        vector<int> instrs;
+        in.get(types, ninstrs);
+        in.get(instrs, ninstrs);
+        in.get(old.memory_map, ninstrs);
+        in.get(old.instrerr, ninstrs);
+        for (uint32_t i = 0; in.ok() && i < ninstrs; i++) {
+            old.program.push_back(Instruction{types[i], instrs[i]});
+        }
+        
+        // ids and slices must stay within what was read
+        bool valid = in.ok() && in.at_end() && static_cast<uint32_t>(old.symbols.size()) == nsymbols;
+        for (size_t m = 0; valid && m < old.modules.size(); m++) {
+            const Module& mod = old.modules[m];
+            valid = mod.base >= 0 && mod.codecount >= 0
+                    && static_cast<long>(mod.base) + mod.codecount <= ninstrs;
+            for (const pair<int, int>& def : mod.deflist) {
+                valid = valid && def.first >= 0 && static_cast<uint32_t>(def.first) < nsymbols;
+            }
+            for (int symbol : mod.uselist) {
+                valid = valid && symbol >= 0 && static_cast<uint32_t>(symbol) < nsymbols;
+            }
+        }
+        if (!valid) {
+            cerr << "Ignoring damaged cache " << path << "." << endl;
+        }
+        return valid;
+    }
+    
+    enum REDO : char {
+        REUSE,      /// the previous relocation still holds
+        MOVED,      /// only E instructions of symbols whose address changed
+        WHOLE
+    };
+    
+    /**
+     * Decide which modules the previous link `old` already relocated. A module
+     * at the same base with the same program text and uselist keeps its words,
+     * errors and uselist usage; they are copied into place here.
+     *
+     * @param[out] moved symbols defined at another address than in `old`, or
+     *     defined in only one of the links
+     * @return how each module must be relocated
+     */
+    vector<REDO> plan(const Cache& old, vector<bool>& moved,
+                      vector<INSTR_ERROR>& instrerr, vector<vector<bool>>& usage) {
+        vector<int> id(old.symbols.size());
+        moved.assign(symbols_.size(), true);
+        for (int c = 0; c < old.symbols.size(); c++) {
+            id[c] = symbols_.find(old.symbols.name(c));
+            if (id[c] >= 0) {
+                moved[id[c]] = old.symbol_table[c] != symbol_table_[id[c]];
+            }
+        }
+        
+        vector<REDO> redo(modules_.size(), WHOLE);
+        for (size_t m = 0; m < min(modules_.size(), old.modules.size()); m++) {
+            const Module& mod = modules_[m];
+            const Module& was = old.modules[m];
+            if (mod.base != was.base || mod.codecount != was.codecount
+                || mod.uselist.size() != was.uselist.size()) continue;
+            bool same = true;
+            for (size_t i = 0; same && i < mod.uselist.size(); i++) {
+                same = id[was.uselist[i]] == mod.uselist[i];
+            }
+            for (int i = mod.base; same && i < mod.base + mod.codecount; i++) {
+                same = program_[i].type == old.program[i].type
+                       && program_[i].instr == old.program[i].instr;
+            }
+            if (!same) continue;
+            
+            copy(old.memory_map.begin() + mod.base, old.memory_map.begin() + mod.base + mod.codecount,
+                 memory_map_.begin() + mod.base);
+            copy(old.instrerr.begin() + mod.base, old.instrerr.begin() + mod.base + mod.codecount,
+                 instrerr.begin() + mod.base);
+            usage[m] = old.usage[m];
+            redo[m] = REUSE;
+            for (int symbol : mod.uselist) {
+                if (moved[symbol]) {
+                    redo[m] = MOVED;
+                }
+            }
+        }
+        return redo;
+    }
+    
+    /**
+     * Layout of a binary image, for tools that mmap it instead of parsing
+     * the memory map. All fields are native-endian and 4-byte aligned; the
+     * offsets are from the start of the file:
+     *
+     *   ImageHeader
+     *   int32_t words[nwords]              relocated words, word i at address i
+     *   ImageSymbol symbols[nsymbols]      in symbol table order
+     *   uint8_t errors[nwords]             INSTR_ERROR of each word, padded to 4
+     *   char strings[strings_size]         NUL-terminated symbol names
+     */
+    struct ImageHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t machine_size;
+        uint32_t radix;                 /// a word is opcode * radix + operand
+        uint32_t nwords;
+        uint32_t nsymbols;
+        uint32_t strings_size;
+        uint32_t words_offset;
+        uint32_t symbols_offset;
+        uint32_t errors_offset;
+        uint32_t strings_offset;
+    };
+    
+    enum IMAGE_SYMBOL_FLAG : uint32_t {
+        MULTIPLE_DEFINED = 1,   /// first value used
+        NEVER_USED = 2
+    };
+    
+    struct ImageSymbol {
+        uint32_t name;          /// offset into the strings
+        uint32_t length;
+        int32_t value;
+        uint32_t flags;         /// IMAGE_SYMBOL_FLAG
+    };
+    
+    static constexpr const char* IMAGE_MAGIC = "LNKIMAGE";
+    static const uint32_t IMAGE_VERSION = 1;
+    
+    /**
+     * Write the linked program to `path` as a binary image, through a
+     * temporary file like the cache
+     *
+     * @param used symbols some module actually used
+     * @return false if it cannot be written
+     */
+    bool save_image(const string& path, const vector<INSTR_ERROR>& instrerr, const vector<bool>& used) {
+        vector<ImageSymbol> symbols;
+        string strings;
+        for (int symbol : first_defs_) {
+            Token name = symbols_.name(symbol);
+            uint32_t flags = (mutiple_defined_[symbol] ? static_cast<uint32_t>(MULTIPLE_DEFINED) : 0u)
+                             | (used[symbol] ? 0u : static_cast<uint32_t>(NEVER_USED));
+            symbols.push_back(ImageSymbol{static_cast<uint32_t>(strings.size()),
+                                          static_cast<uint32_t>(name.size()),
+                                          symbol_table_[symbol], flags});
+            strings.append(name.begin(), name.size());
+            strings.push_back('\0');
+        }
+        vector<char> errors(instrerr.begin(), instrerr.end());
+        errors.resize((errors.size() + 3) / 4 * 4, NO_ERROR);
+        
+        ImageHeader header;
+        memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+        header.version = IMAGE_VERSION;
+        header.machine_size = machine_size_;
+        header.radix = radix_;
+        header.nwords = static_cast<uint32_t>(memory_map_.size());
+        header.nsymbols = static_cast<uint32_t>(symbols.size());
+        header.strings_size = static_cast<uint32_t>(strings.size());
+        header.words_offset = sizeof(ImageHeader);
+        header.symbols_offset = header.words_offset + header.nwords * sizeof(int32_t);
+        header.errors_offset = header.symbols_offset + header.nsymbols * sizeof(ImageSymbol);
+        header.strings_offset = header.errors_offset + static_cast<uint32_t>(errors.size());
+        
+        const string tmp = path + ".tmp";
+        ofstream os(tmp, ios::binary | ios::trunc);
+        put(os, header);
+        put(os, memory_map_);
+        put(os, symbols);
+        put(os, errors);
+        os.write(strings.data(), strings.size());
+        os.close();
+        if (!os || rename(tmp.c_str(), path.c_str()) != 0) {
+            cerr << "Cannot write image " << path << "." << endl;
+            remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+public:
+    static long radix(int digits) {
+        long r = 1;
+        while (digits-- > 0) {
+            r *= 10;
+        }
+        return r;
+    }
+    
+private:
+    static int digits(int n) {
+        int d = 1;
+        while (n >= 10) {
+            n /= 10;
+            d++;
+        }
+        return d;
+    }
+    
 public:
     static const int MACHINE_SIZE = 512;
     static const int LIST_SIZE = 16;
+    static const int OPERAND_WIDTH = 3;
+    static const int MAX_OPERAND_WIDTH = 8;     /// instructions still fit an int
     
-    Linker(const string infile) : infile_(infile) {}
+    /**
+     * @param machine_size words of memory, at most 10^`operand_width`
+     * @param list_size most symbols in a deflist or uselist
+     * @param operand_width decimal digits of an operand; the opcode is one more
+     */
+    Linker(const vector<string>& inputs, int machine_size = MACHINE_SIZE,
+           int list_size = LIST_SIZE, int operand_width = OPERAND_WIDTH) :
+    inputs_(inputs),
+    machine_size_(machine_size),
+    list_size_(list_size),
+    radix_(static_cast<int>(radix(operand_width))),
+    addr_width_(max(3, digits(machine_size-1))) {}
     
-    bool pass1() {
-        Tokenizer tokenizer(infile_);
-        vector<string> deflist;
-        vector<int> defaddr;
-        unordered_map<string, bool> mutiple_defined;
-        
-        int module = 1, module_addr = 0, p = 0;
-        
+    /// Tokenize `unit.path` into `unit`, stopping at the first parse error
+    void tokenize(Unit& unit) {
+        Tokenizer tokenizer(unit.path);
+        unit.archive = tokenizer.read_magic("!<arch>");
         try {
             while (!tokenizer.eof()) {
                 // parse define list
                 int defcount = tokenizer.read_int();
-                if (defcount > LIST_SIZE) {
+                if (defcount > list_size_) {
                     throw PARSE_ERROR::TOO_MANY_DEF_IN_MODULE;
                 }
+                unit.modules.push_back(Module());
+                unit.counts.push_back(make_pair(0, 0));
+                Module& mod = unit.modules.back();
+                mod.base = static_cast<int>(unit.program.size());
+                mod.codecount = -1;
                 for (int i = 0; i < defcount; i++) {
-                    string symbol = tokenizer.read_symbol();
+                    int symbol = unit.symbols.intern(tokenizer.read_symbol());
                     int rel_addr = tokenizer.read_int();
-                    deflist.push_back(symbol);
-                    defaddr.push_back(rel_addr);
+                    mod.deflist.push_back(make_pair(symbol, rel_addr));
                 }
                 
                 // parse use list
                 int usecount = tokenizer.read_int();
-                if (usecount > LIST_SIZE) {
+                if (usecount > list_size_) {
                     throw PARSE_ERROR::TOO_MANY_USE_IN_MODULE;
                 }
                 while (usecount-- > 0) {
-                    tokenizer.read_symbol();
+                    mod.uselist.push_back(unit.symbols.intern(tokenizer.read_symbol()));
                 }
                 
-                // parse program text
+                // parse program text; whether it fits depends on where the
+                // module is placed, but more than the machine never fits
                 int codecount = tokenizer.read_int();
-                if (module_addr+codecount > MACHINE_SIZE) {
+                mod.codecount = codecount;
+                unit.counts.back() = make_pair(tokenizer.linenum(), tokenizer.lineoffset());
+                if (codecount > machine_size_) {
                     throw PARSE_ERROR::TOO_MANY_INSTR;
                 }
                 for (int i = 0; i < codecount; i++) {
-                    tokenizer.read_IAER();
-                    tokenizer.read_int();
+                    char type = tokenizer.read_IAER()[0];
+                    unit.program.push_back(Instruction{type, tokenizer.read_int()});
                 }
-                
-                // Generate symbol table
-                while (p < deflist.size()) {
-                    const string symbol = deflist[p];
-                    
-                    if (symbol_table_.find(symbol) == symbol_table_.end()) {
-                        symbol_table_[symbol] = defaddr[p] + module_addr;
-                        mutiple_defined[symbol] = false;
-                    } else {
-                        mutiple_defined[symbol] = true;
-                        deflist.erase(deflist.begin()+p);
-                        defaddr.erase(defaddr.begin()+p);
-                        p--;
-                    }
-                    
-                    // check symbol relative address size
-                    const int rel_addr = symbol_table_[symbol] - module_addr;
-                    if (rel_addr >= codecount) {
-                        cout << "Warning: Module " << module << ": " << symbol << " too big " << rel_addr << " (max=" << codecount-1 << ") assume zero relative" << endl;
-                        symbol_table_[symbol] = module_addr;
-                    }
-                    
-                    p++;
-                }
-                
-                module++;
-                module_addr += codecount;
+                unit.complete++;
             }
-            print_symbol_table(deflist, mutiple_defined);
         } catch (PARSE_ERROR errcode) {
-            tokenizer.parseerror(errcode);
-            return false;
+            unit.failed = true;
+            unit.errcode = errcode;
+            unit.linenum = tokenizer.linenum();
+            unit.lineoffset = tokenizer.lineoffset();
+        } catch (const out_of_range&) {
+            unit.failed = true;
+            unit.overflow = true;
         }
-        return true;
     }
     
-    void pass2() {
-        Tokenizer tokenizer(infile_);
-        vector<vector<string>> deforder;
-        unordered_map<string, bool> definelist_usage;
-        unordered_set<string> unique_defsymbol;
-        vector<string> instrerr;
-        vector<pair<int, string>> moderr;
-        
-        int module_addr = 0;
-        
-        while (!tokenizer.eof()) {
-            //parse define list
-            int defcount = tokenizer.read_int();
-            vector<string> deflist;
-            for (int i = 0; i < defcount; i++) {
-                string symbol = tokenizer.read_symbol();
-                tokenizer.read_int();
-                if (unique_defsymbol.find(symbol) == unique_defsymbol.end()) {
-                    deflist.push_back(symbol);
-                }
-                definelist_usage[symbol]; // insert default value false, if non-existance
-                unique_defsymbol.insert(symbol);
+    void parseerror(const Unit& unit, PARSE_ERROR errcode, int linenum, int lineoffset) {
+        if (unit.overflow && errcode != TOO_MANY_INSTR) {
+            // as the input would have, had it been tokenized right here
+            throw out_of_range("stoi");
+        }
+        if (inputs_.size() > 1) {
+            cout << unit.path << ": ";
+        }
+        Tokenizer::parseerror(errcode, linenum, lineoffset);
+    }
+    
+    /**
+     * Link module `m` of `unit` at the end of the program and add its
+     * definitions to the symbol table
+     *
+     * @param ids global ids of the symbols of `unit`, -1 until interned
+     * @param in_place the words of `unit` already are the start of `program_`
+     * @return false if it does not fit the machine
+     */
+    bool place(Unit& unit, size_t m, vector<int>& ids, bool in_place) {
+        const Module& parsed = unit.modules[m];
+        const int module_addr = next_addr();
+        const int codecount = parsed.codecount;
+        if (module_addr+codecount > machine_size_) {
+            parseerror(unit, TOO_MANY_INSTR, unit.counts[m].first, unit.counts[m].second);
+            return false;
+        }
+        
+        auto global = [&](int symbol) {
+            if (ids[symbol] < 0) {
+                ids[symbol] = symbols_.intern(unit.symbols.name(symbol));
             }
-            deforder.push_back(deflist);
+            return ids[symbol];
+        };
+        modules_.push_back(Module());
+        Module& mod = modules_.back();
+        mod.base = module_addr;
+        mod.codecount = codecount;
+        for (const pair<int, int>& def : parsed.deflist) {
+            mod.deflist.push_back(make_pair(global(def.first), def.second));
+        }
+        for (int symbol : parsed.uselist) {
+            mod.uselist.push_back(global(symbol));
+        }
+        if (!in_place) {
+            program_.insert(program_.end(), unit.program.begin() + parsed.base,
+                            unit.program.begin() + parsed.base + codecount);
+        }
+        symbol_table_.resize(symbols_.size(), UNDEFINED);
+        mutiple_defined_.resize(symbols_.size(), false);
+        referenced_.resize(symbols_.size(), false);
+        for (int symbol : mod.uselist) {
+            referenced_[symbol] = true;
+        }
+        
+        // Generate symbol table
+        for (const pair<int, int>& def : mod.deflist) {
+            const int symbol = def.first;
             
-            // parse use list
-            vector<string> uselist;
-            vector<bool> uselist_usage;
-            int usecount = tokenizer.read_int();
-            while (usecount-- > 0) {
-                string symbol = tokenizer.read_symbol();
-                uselist.push_back(symbol);
-                uselist_usage.push_back(false);
+            if (symbol_table_[symbol] == UNDEFINED) {
+                symbol_table_[symbol] = def.second + module_addr;
+                first_defs_.push_back(symbol);
+            } else {
+                mutiple_defined_[symbol] = true;
             }
             
-            // parse program text
-            int codecount = tokenizer.read_int();
-            for (int i = 0; i < codecount; i++) {
-                string type = tokenizer.read_IAER();
-                string err = "";
-                int instr = tokenizer.read_int();
-                int opcode = instr / 1000;
-                int operand = instr % 1000;
-                if (type == "I") {
-                    if (instr >= 10000) {
-                        opcode = 9;
-                        operand = 999;
-                        err = " Error: Illegal immediate value; treated as 9999";
-                    }
-                } else if (opcode >= 10) {
-                    opcode = 9;
-                    operand = 999;
-                    err = " Error: Illegal opcode; treated as 9999";
-                } else if (type == "R") {
-                    if (operand >= codecount) {
-                        operand = 0;
-                        err = " Error: Relative address exceeds module size; zero used";
-                    }
-                    operand += module_addr;
-                } else if (type == "E") {
-                    if (operand >= uselist.size()) {
-                        err = " Error: External address exceeds length of uselist; treated as immediate";
-                    } else if (symbol_table_.find( uselist[operand] ) == symbol_table_.end()) {
-                        uselist_usage[operand] = true;
-                        err = " Error: " + uselist[operand] + " is not defined; zero used";
-                        operand = 0;
-                    } else {
-                        uselist_usage[operand] = true;
-                        operand = symbol_table_[ uselist[operand] ];
+            // check symbol relative address size
+            const int rel_addr = symbol_table_[symbol] - module_addr;
+            if (rel_addr >= codecount) {
+                cout << "Warning: Module " << modules_.size() << ": " << symbols_.name(symbol) << " too big " << rel_addr << " (max=" << codecount-1 << ") assume zero relative" << endl;
+                symbol_table_[symbol] = module_addr;
+            }
+        }
+        return true;
+    }
+    
+    /// Address of the next module linked
+    int next_addr() const {
+        return modules_.empty() ? 0 : modules_.back().base + modules_.back().codecount;
+    }
+    
+    /// Whether archive member `m` of `unit` defines a symbol that is still undefined
+    bool resolves(const Unit& unit, size_t m) {
+        for (const pair<int, int>& def : unit.modules[m].deflist) {
+            int symbol = symbols_.find(unit.symbols.name(def.first));
+            if (symbol >= 0 && referenced_[symbol] && symbol_table_[symbol] == UNDEFINED) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    /**
+     * Place the modules of `unit` in the link, archive members only while
+     * they resolve an undefined symbol
+     *
+     * @return false on a parse error, reported after the modules before it
+     */
+    bool link_unit(Unit& unit) {
+        vector<int> ids(unit.symbols.size(), -1);
+        if (unit.archive) {
+            if (unit.failed) {
+                parseerror(unit, unit.errcode, unit.linenum, unit.lineoffset);
+                return false;
+            }
+            // a member may resolve what an earlier pulled member left undefined
+            vector<bool> pulled(unit.modules.size(), false);
+            for (bool again = true; again; ) {
+                again = false;
+                for (size_t m = 0; m < unit.modules.size(); m++) {
+                    if (pulled[m] || !resolves(unit, m)) continue;
+                    if (!place(unit, m, ids, false)) {
+                        return false;
                     }
-                } else {
-                    if (operand >= MACHINE_SIZE) {
-                        operand = 0;
-                        err = " Error: Absolute address exceeds machine size; zero used";
+                    pulled[m] = again = true;
+                }
+            }
+            return true;
+        }
+        
+        // the words of the first object file need not be copied
+        const bool in_place = program_.empty();
+        if (in_place) {
+            program_.swap(unit.program);
+        }
+        for (size_t m = 0; m < unit.modules.size(); m++) {
+            const int codecount = unit.modules[m].codecount;
+            if (m == unit.complete) {
+                // stopped inside this module: it may not fit before it fails
+                if (codecount >= 0 && next_addr() + codecount > machine_size_) {
+                    parseerror(unit, TOO_MANY_INSTR, unit.counts[m].first, unit.counts[m].second);
+                }
+                else {
+                    parseerror(unit, unit.errcode, unit.linenum, unit.lineoffset);
+                }
+                return false;
+            }
+            if (!place(unit, m, ids, in_place)) {
+                return false;
+            }
+        }
+        if (unit.failed && unit.modules.size() == unit.complete) {
+            parseerror(unit, unit.errcode, unit.linenum, unit.lineoffset);
+            return false;
+        }
+        return true;
+    }
+    
+    /**
+     * Tokenize the inputs once, on up to `jobs` threads, into `modules_` and
+     * `program_` and build the symbol table; pass2 relocates from them.
+     * Modules are linked in input order whatever order the files are read in.
+     *
+     * @param listing print the symbol table; a binary image carries it instead
+     * @return false on a parse error
+     */
+    bool pass1(unsigned int jobs = 1, bool listing = true) {
+        vector<Unit> units(inputs_.size());
+        atomic<size_t> next(0);
+        auto reader = [&]() {
+            size_t u;
+            while ((u = next++) < units.size()) {
+                units[u].path = inputs_[u];
+                tokenize(units[u]);
+            }
+        };
+        vector<thread> pool;
+        jobs = static_cast<unsigned int>(min<size_t>(jobs, units.size()));
+        for (unsigned int t = 1; t < jobs; t++) {
+            pool.emplace_back(reader);
+        }
+        reader();
+        for (thread& t : pool) {
+            t.join();
+        }
+        
+        for (Unit& unit : units) {
+            if (!link_unit(unit)) {
+                return false;
+            }
+            // free what was tokenized as soon as it is linked
+            unit = Unit();
+        }
+        if (listing) {
+            print_symbol_table(first_defs_, mutiple_defined_);
+        }
+        return true;
+    }
+    
+    /**
+     * Relocate the word at `addr` of `mod` into the memory map. Modules only
+     * share the symbol table, which is read-only by now.
+     *
+     * @param[out] uselist_usage which uselist entries an E instruction used
+     */
+    void relocate_word(const Module& mod, int addr, vector<INSTR_ERROR>& instrerr,
+                       vector<bool>& uselist_usage) {
+        const int module_addr = mod.base;
+        const int codecount = mod.codecount;
+        const vector<int>& uselist = mod.uselist;
+        const char type = program_[addr].type;
+        INSTR_ERROR err = NO_ERROR;
+        int instr = program_[addr].instr;
+        int opcode = instr / radix_;
+        int operand = instr % radix_;
+        if (type == 'I') {
+            if (instr >= 10*radix_) {
+                opcode = 9;
+                operand = radix_ - 1;
+                err = ILLEGAL_IMMEDIATE;
+            }
+        } else if (opcode >= 10) {
+            opcode = 9;
+            operand = radix_ - 1;
+            err = ILLEGAL_OPCODE;
+        } else if (type == 'R') {
+            if (operand >= codecount) {
+                operand = 0;
+                err = REL_EXCEEDS_MODULE;
+            }
+            operand += module_addr;
+        } else if (type == 'E') {
+            if (static_cast<size_t>(operand) >= uselist.size()) {
+                err = EXT_EXCEEDS_USELIST;
+            } else if (symbol_table_[ uselist[operand] ] == UNDEFINED) {
+                uselist_usage[operand] = true;
+                err = SYM_NOT_DEFINED;
+                operand = 0;
+            } else {
+                uselist_usage[operand] = true;
+                operand = symbol_table_[ uselist[operand] ];
+            }
+        } else {
+            if (operand >= machine_size_) {
+                operand = 0;
+                err = ABS_EXCEEDS_MACHINE;
+            }
+        }
+        memory_map_[addr] = opcode*radix_ + operand;
+        instrerr[addr] = err;
+    }
+    
+    /// Relocate the program text of `mod` into its slice of the memory map
+    void relocate(const Module& mod, vector<INSTR_ERROR>& instrerr, vector<bool>& uselist_usage) {
+        uselist_usage.assign(mod.uselist.size(), false);
+        for (int i = mod.base; i < mod.base + mod.codecount; i++) {
+            relocate_word(mod, i, instrerr, uselist_usage);
+        }
+    }
+    
+    /// Relocate again only the E instructions of `mod` that use a `moved` symbol
+    void relocate_moved(const Module& mod, const vector<bool>& moved,
+                        vector<INSTR_ERROR>& instrerr, vector<bool>& uselist_usage) {
+        for (int i = mod.base; i < mod.base + mod.codecount; i++) {
+            int operand = program_[i].instr % radix_;
+            if (program_[i].type == 'E' && static_cast<size_t>(operand) < mod.uselist.size()
+                && moved[mod.uselist[operand]]) {
+                relocate_word(mod, i, instrerr, uselist_usage);
+            }
+        }
+    }
+    
+    /**
+     * Relocate the program text pass1 kept, without reading the input again.
+     * Modules are relocated on `jobs` threads, then their warnings are merged
+     * in module order. Only call after pass1 succeeded.
+     *
+     * @param cache if not empty, relocate only what changed since the link
+     *     that wrote this cache, and write the cache for the next link
+     * @param image if not empty, write the program to this binary image
+     *     instead of printing the memory map; only warnings are printed
+     * @return false if the image cannot be written
+     */
+    bool pass2(unsigned int jobs = 1, const string& cache = "", const string& image = "") {
+        vector<vector<int>> deforder;
+        vector<bool> definelist_usage(symbols_.size(), false);
+        vector<bool> unique_defsymbol(symbols_.size(), false);
+        vector<INSTR_ERROR> instrerr(program_.size());
+        vector<vector<bool>> usage(modules_.size());
+        memory_map_.resize(program_.size());
+        
+        vector<REDO> redo(modules_.size(), WHOLE);
+        vector<bool> moved;
+        Cache old;
+        if (!cache.empty() && load_cache(cache, old)) {
+            redo = plan(old, moved, instrerr, usage);
+        }
+        
+        // threads take modules in chunks, each writing only its own slices
+        const size_t CHUNK = 64;
+        atomic<size_t> next(0);
+        auto worker = [&]() {
+            size_t first;
+            while ((first = next.fetch_add(CHUNK)) < modules_.size()) {
+                size_t last = min(first + CHUNK, modules_.size());
+                for (size_t m = first; m < last; m++) {
+                    if (redo[m] == WHOLE) {
+                        relocate(modules_[m], instrerr, usage[m]);
+                    } else if (redo[m] == MOVED) {
+                        relocate_moved(modules_[m], moved, instrerr, usage[m]);
                     }
                 }
-                memory_map_.push_back(opcode*1000 + operand);
-                instrerr.push_back(err);
             }
+        };
+        vector<thread> pool;
+        jobs = static_cast<unsigned int>(min<size_t>(jobs, (modules_.size() + CHUNK-1) / CHUNK));
+        for (unsigned int t = 1; t < jobs; t++) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (thread& t : pool) {
+            t.join();
+        }
+        
+        for (size_t m = 0; m < modules_.size(); m++) {
+            const Module& mod = modules_[m];
+            
+            vector<int> deflist;
+            for (const pair<int, int>& def : mod.deflist) {
+                const int symbol = def.first;
+                if (!unique_defsymbol[symbol]) {
+                    deflist.push_back(symbol);
+                }
+                unique_defsymbol[symbol] = true;
+            }
+            deforder.push_back(deflist);
             
-            // Appeared in uselist but not actually used
-            moderr.push_back(make_pair(module_addr+codecount, ""));
-            for (int i = 0; i < uselist.size(); i++) {
-                definelist_usage[ uselist[i] ] |= uselist_usage[i];
-                if (!uselist_usage[i]) {
-                    string err = "Warning: Module " + to_string(deforder.size()) + ": " + uselist[i] + " appeared in the uselist but was not actually used\n";
-                    moderr.back().second += err;
+            for (size_t i = 0; i < mod.uselist.size(); i++) {
+                if (usage[m][i]) {
+                    definelist_usage[ mod.uselist[i] ] = true;
                 }
             }
-            module_addr += codecount;
         }
         
-        print_memory_map(instrerr, moderr);
+        bool written = true;
+        if (image.empty()) {
+            print_memory_map(instrerr, usage);
+        }
+        else {
+            written = save_image(image, instrerr, definelist_usage);
+            for (size_t m = 0; m < modules_.size(); m++) {
+                print_uselist_warnings(m, usage[m]);
+            }
+        }
         
         // Defined but never used Warning
-        for (int i = 0; i < deforder.size(); i++) {
-            for (const string& symbol : deforder[i]) {
+        for (size_t i = 0; i < deforder.size(); i++) {
+            for (int symbol : deforder[i]) {
                 if (!definelist_usage[symbol]) {
                     cout << "Warning: Module " << i+1 << ": "
-                         << symbol << " was defined but never used" << endl;
+                         << symbols_.name(symbol) << " was defined but never used" << endl;
                 }
             }
         }
+        
+        if (!cache.empty()) {
+            save_cache(cache, instrerr, usage);
+        }
+        return written;
     }
 };
 
-int main(int argc, const char * argv[]) {
-    Linker linker(argv[1]);
+const int Linker::UNDEFINED;
+constexpr const char* Linker::CACHE_MAGIC;
+const int Linker::CACHE_VERSION;
+constexpr const char* Linker::IMAGE_MAGIC;
+const uint32_t Linker::IMAGE_VERSION;
+
+/**
+ * -m<words> machine size, -l<symbols> deflist/uselist limit and -w<digits>
+ * operand width, for images larger than the default 512 words;
+ * -j<threads> reads inputs and relocates modules in parallel; -i<cache>
+ * relinks incrementally, relocating only what changed since the link that
+ * wrote the cache; -o<image> writes a binary image instead of the symbol
+ * table and memory map. The inputs that follow are linked in order, archives
+ * contributing only the members that define a symbol still undefined
+ *
+ * @return true on a bad option
+ */
+bool cmd_option(int argc, char* const argv[], int& machine_size, int& list_size, int& width,
+                int& jobs, string& cache, string& image) {
+    opterr = 0;
+    int o;
+    while ((o = getopt(argc, argv, "m:l:w:j:i:o:")) != -1) {
+        switch (o) {
+            case 'm':
+                machine_size = atoi(optarg);
+                break;
+            case 'l':
+                list_size = atoi(optarg);
+                break;
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                break;
+            case 'i':
+                cache = optarg;
+                break;
+            case 'o':
+                image = optarg;
+                break;
+            case '?':
+                if (optopt == 'm' || optopt == 'l' || optopt == 'w' || optopt == 'j'
+                    || optopt == 'i' || optopt == 'o')
+                    cerr << "Option -" << char(optopt)
+                         << " requires an argument." << endl;
+                else
+                    cerr << "Unknown option `-" << char(optopt)
+                         << "'." << endl;
+                return true;
+        }
+    }
+    if (width < Linker::OPERAND_WIDTH || width > Linker::MAX_OPERAND_WIDTH) {
+        cerr << "Operand width must be between " << Linker::OPERAND_WIDTH
+             << " and " << Linker::MAX_OPERAND_WIDTH << " digits." << endl;
+        return true;
+    }
+    if (machine_size < 1 || machine_size > Linker::radix(width)) {
+        cerr << "Machine size must be between 1 and " << Linker::radix(width)
+             << " words for " << width << "-digit operands." << endl;
+        return true;
+    }
+    if (list_size < 0) {
+        cerr << "List size must not be negative." << endl;
+        return true;
+    }
+    if (jobs < 1) {
+        cerr << "Need at least one relocation thread." << endl;
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* const argv[]) {
+    int machine_size = Linker::MACHINE_SIZE;
+    int list_size = Linker::LIST_SIZE;
+    int width = Linker::OPERAND_WIDTH;
+    int jobs = max(1u, thread::hardware_concurrency());
+    string cache, image;
+    if (cmd_option(argc, argv, machine_size, list_size, width, jobs, cache, image)) {
+        return 1;
+    }
+    if (optind >= argc) {
+        cerr << "At least one input file is required." << endl;
+        return 1;
+    }
+    // memory maps of millions of lines
+    ios::sync_with_stdio(false);
+    
+    Linker linker(vector<string>(argv + optind, argv + argc), machine_size, list_size, width);
 
-    if (linker.pass1()) {
-        linker.pass2();
+    if (linker.pass1(jobs, image.empty()) && !linker.pass2(jobs, cache, image)) {
+        return 1;
     }
     
     return 0;
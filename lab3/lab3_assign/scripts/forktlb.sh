@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# TLB check for pids past 15: process 0 forks 16 children, child 16 reads
+# four pages twice, then process 0 reads the same four pages. Child 16 must
+# hit on its second pass and process 0 must miss on pages it never touched:
+#
+#   ./forktlb.sh ../../mmu ../inputs/rfile
+
+MMU=${1:-../../mmu}
+RFILE=${2:-../inputs/rfile}
+TRACE=$(mktemp)
+trap "rm -f ${TRACE}" EXIT
+
+{
+	echo "1"
+	echo "1"
+	echo "0 63 0 0"
+	echo "c 0"
+	for i in $(seq 1 16); do echo "f $i"; done
+	echo "c 16"
+	for k in 1 2; do for p in 1 2 3 4; do echo "r $p"; done; done
+	echo "c 0"
+	for p in 1 2 3 4; do echo "r $p"; done
+} > ${TRACE}
+
+OUT=$(${MMU} -f32 -af -t16:4:a -oPS ${TRACE} ${RFILE})
+P0=$(echo "${OUT}" | egrep -o "^PROC\[0\]:.* TH=[0-9]+ TM=[0-9]+" | egrep -o "TH=[0-9]+ TM=[0-9]+")
+P16=$(echo "${OUT}" | egrep -o "^PROC\[16\]:.* TH=[0-9]+ TM=[0-9]+" | egrep -o "TH=[0-9]+ TM=[0-9]+")
+
+if [[ "${P0}" == "TH=0 TM=4" && "${P16}" == "TH=4 TM=4" ]]; then
+	echo "forktlb: ok"
+else
+	echo "forktlb: proc 0 ${P0}, expected TH=0 TM=4; proc 16 ${P16}, expected TH=4 TM=4"
+	exit 1
+fi
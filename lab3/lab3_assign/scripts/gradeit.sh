@@ -62,6 +62,30 @@ for I in ${INPUTS}; do
   done
 done
 
+# one run per mode, see `modes`; the output and any file written next to it
+MODES=`dirname $0`/modes
+for M in `grep -v "^#" ${MODES} | cut -d" " -f1`; do
+    OUTLINE=`printf "%-15s" "${M}"`
+    if [[ ! -e ${DIR1}/out_${M} ]]; then
+        echo "${DIR1}/out_${M} does not exist" >> ${LOG}
+        OUTLINE=`printf "%s o" "${OUTLINE}"`
+    fi;
+    for OUTF in `cd ${DIR1} && ls out_${M} out_${M}.* 2>/dev/null`; do
+        if [[ ! -e ${DIR2}/${OUTF} ]]; then
+            echo "${DIR2}/${OUTF} does not exist" >> ${LOG}
+            OUTLINE=`printf "%s o" "${OUTLINE}"`
+            continue;
+        fi;
+        DIFF=`diff -b ${DARGS} ${DIR1}/${OUTF} ${DIR2}/${OUTF}`
+        if [[ "${DIFF}" == "" ]]; then
+            OUTLINE=`printf "%s  ." "${OUTLINE}"`
+        else
+            echo "diff -b ${DARGS} ${DIR1}/${OUTF} ${DIR2}/${OUTF} failed" >> ${LOG}
+            OUTLINE=`printf "%s  x" "${OUTLINE}"`
+        fi
+    done
+    echo "${OUTLINE}"
+done
 
 OUTLINE=`printf "%-15s" "SUM"`
 x=0
@@ -22,3 +22,12 @@ for I in ${INPUTS}; do
    done
 done
 
+# one run per mode, see `modes`
+grep -v "^#" `dirname $0`/modes | while read M MARGS; do
+   OUTF="${OUTDIR}/out_${M}"
+   MARGS=${MARGS//@OUT@/${OUTF}}
+   echo "${PROG} ${MARGS} ${INDIR}/${M} ${INDIR}/rfile > ${OUTF}"
+   ${PROG} ${MARGS} ${INDIR}/${M} ${INDIR}/rfile > ${OUTF}
+   OUTPUT=`egrep "^TOTAL" ${OUTF}`
+   echo "${M}: ${OUTPUT}"
+done
@@ -1,5 +1,9 @@
 #include <iostream>
 #include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <unistd.h>
 #include "mmu.hpp"
 
@@ -14,138 +18,859 @@ bool OPTION_a = false;
 bool OPTION_f = false;
 bool OPTION_x = false;
 bool OPTION_y = false;
+bool PROFILE = false;
+
+unsigned int TLB_WAYS = 1;
+bool TLB_ASID = true;
+bool TLB_LRU = true;
+
+bool SWAP_MODEL = false;
+unsigned int SWAP_WINDOW = 0;
+bool SWAP_WRITEBACK = true;
+
+unsigned long SAMPLE_INTERVAL = 0;      /// 0 disables sampling
+string SAMPLE_FILE;
+bool SAMPLE_BINARY = false;
 
 Pager* pager = nullptr;
 
-unsigned int allocate_frame(unsigned int vpage) {
+/**
+ * The pager as its concrete type. The fault path is instantiated per pager
+ * type, and calls qualified with `P::` through this are bound statically.
+ */
+template <typename P>
+inline P& the_pager() {
+    return *static_cast<P*>(::pager);
+}
+thread_local TLB* tlb = nullptr;
+SwapDevice* swap_device = nullptr;
+Sampler* sampler = nullptr;
+
+/// One simulated CPU of `-m`, replaying its share of the trace on a thread
+struct Cpu {
+    vector<Instruction> trace;
+    TLB* tlb = nullptr;
+    mutex tlb_lock;                     /// owner lookups vs. remote shootdowns
+    atomic<unsigned int> pid{0};        /// process currently running here
+    unsigned long instructions = 0;
+    unsigned long published = 0;        /// of `instructions`, added to `retired`
+    unsigned long switches = 0;
+    unsigned long exits = 0;
+    unsigned long shootdowns = 0;
+    unsigned long long cost = 0;
+};
+
+deque<Cpu> cpus;
+thread_local Cpu* this_cpu = nullptr;
+mutex fault_lock;                       /// pager, `free_frames`, scanned `frame_table` fields
+mutex cache_lock;                       /// `page_cache`, taken after any frame lock
+atomic<unsigned long> retired{0};       /// instructions retired by all CPUs
+
+/**
+ * Take the pager lock of `-m`, bringing `INSTR_COUNT`, which pagers age by,
+ * up to the global count. One CPU takes no locks.
+ */
+unique_lock<mutex> lock_pager() {
+    if (NUM_CPUS == 1) return unique_lock<mutex>();
+    unique_lock<mutex> guard(fault_lock);
+    INSTR_COUNT = retired += this_cpu->instructions - this_cpu->published;
+    this_cpu->published = this_cpu->instructions;
+    return guard;
+}
+
+inline unique_lock<mutex> lock_cache() {
+    return NUM_CPUS > 1 ? unique_lock<mutex>(cache_lock) : unique_lock<mutex>();
+}
+
+/**
+ * Invalidate a translation on every CPU. Another CPU that may still use it
+ * costs an IPI: it either caches it in its TLB or, without a TLB model, runs
+ * the owning process.
+ */
+void shootdown(unsigned int pid, unsigned int vpage) {
+    for (Cpu& cpu : cpus) {
+        bool cached;
+        if (cpu.tlb) {
+            lock_guard<mutex> guard(cpu.tlb_lock);
+            cached = cpu.tlb->invalidate(pid, vpage);
+        }
+        else {
+            cached = cpu.pid == pid;
+        }
+        if (cached && &cpu != this_cpu) {
+            this_cpu->shootdowns++;
+            process_pool[pid].shootdowns++;
+            COST += COST_TABLE::SHOOTDOWNS;
+        }
+    }
+}
+
+/// A huge page has one TLB entry, tagged with its first vpage
+inline unsigned int tlb_page(const PTE& pte, unsigned int vpage) {
+    return pte.huge ? vpage - vpage % HUGE_PAGES : vpage;
+}
+
+/**
+ * Unmap the page held in `f` from every process on its rmap chain. A huge
+ * page goes as a whole. The page is written back once if any sharer dirtied
+ * it, charged to the first such sharer; every base page of a huge page is
+ * written.
+ *
+ * @return whether `f` held a huge page
+ */
+template <bool TRACE>
+bool evict_frame(unsigned int f) {
+    auto guard = lock_frame(f);
+    bool huge = snapshot(reversed_map(f)).huge;
+    unsigned int pages = huge ? HUGE_PAGES : 1;
+    Process* writer = nullptr;
+    unsigned int written = 0;
+    bool file_mapped = false;
+    auto unmap_owner = [&](unsigned int pid, unsigned int vpage) {
+        Process& proc = process_pool[pid];
+        if (TRACE && OPTION_O) {
+            cout << (huge ? " HUNMAP " : " UNMAP ") << pid << ":" << vpage << endl;
+        }
+        if (huge) {
+            proc.huge_unmaps++;
+            COST += COST_TABLE::HUGE_UNMAPS;
+        }
+        else {
+            proc.count(vpage).unmaps++;
+            COST += COST_TABLE::UNMAPS;
+        }
+        PTE old = unmap(proc.page_table[vpage]);
+        for (unsigned int i = 1; i < pages; i++) {
+            unmap(proc.page_table[vpage+i]);
+        }
+        for (unsigned int i = 0; i < pages; i++) {
+            proc.resident.erase(vpage+i);
+            proc.stale.insert(vpage+i);
+        }
+        if (NUM_CPUS > 1) {
+            shootdown(pid, vpage);
+        }
+        else if (::tlb) {
+            ::tlb->invalidate(pid, vpage);
+        }
+        if (old.modified && !writer) {
+            writer = &proc;
+            written = vpage;
+            file_mapped = old.file_mapped;
+        }
+    };
+    auto page_out = [&](unsigned int pid, unsigned int vpage) {
+        for (unsigned int i = 0; i < pages; i++) {
+            set_paged_out(process_pool[pid].page_table[vpage+i]);
+        }
+    };
+    
+    Frame& frame = frame_table[f];
+    unmap_owner(frame.pid_rv, frame.vpage_rv);
+    for (const Mapping& m : frame.sharers) {
+        unmap_owner(m.pid, m.vpage);
+    }
+    if (writer) {
+        if (!file_mapped) {
+            page_out(frame.pid_rv, frame.vpage_rv);
+            for (const Mapping& m : frame.sharers) {
+                page_out(m.pid, m.vpage);
+            }
+        }
+        for (unsigned int i = 0; i < pages; i++) {
+            if (TRACE && OPTION_O) {
+                cout << (file_mapped ? " FOUT" : " OUT") << endl;
+            }
+            Counters& counters = writer->count(written+i);
+            (file_mapped ? counters.fouts : counters.outs)++;
+            if (file_mapped) {
+                COST += COST_TABLE::FOUTS;
+            }
+            else if (::swap_device) {
+                COST += ::swap_device->write(COST);
+            }
+            else {
+                COST += COST_TABLE::OUTS;
+            }
+        }
+    }
+    else if (::swap_device && frame.cleaned) {
+        ::swap_device->cleaned_eviction();
+    }
+    frame.sharers.clear();
+    if (frame.file_page >= 0) {
+        auto cache_guard = lock_cache();
+        page_cache.erase(frame.file_page);
+        frame.file_page = -1;
+    }
+    return huge;
+}
+
+/// Add (`pid`, `vpage`) to the rmap chain of a mapped frame
+void add_owner(unsigned int f, unsigned int pid, unsigned int vpage) {
+    frame_table[f].sharers.push_back(Mapping{pid, vpage});
+}
+
+/**
+ * Drop (`pid`, `vpage`) from the rmap chain of `f`. The leaving sharer hands
+ * its R and M bits on, so neither the write-back nor a reference the pager
+ * was told about is lost.
+ *
+ * @return whether it was the last process mapping `f`
+ */
+bool remove_owner(unsigned int f, unsigned int pid, unsigned int vpage) {
+    Frame& frame = frame_table[f];
+    if (frame.sharers.empty()) return true;
+    PTE leaving = snapshot(process_pool[pid].page_table[vpage]);
+    if (frame.pid_rv == pid && frame.vpage_rv == vpage) {
+        frame.pid_rv = frame.sharers.back().pid;
+        frame.vpage_rv = frame.sharers.back().vpage;
+        frame.sharers.pop_back();
+    }
+    else {
+        for (size_t i = 0; i < frame.sharers.size(); i++) {
+            if (frame.sharers[i].pid == pid && frame.sharers[i].vpage == vpage) {
+                frame.sharers[i] = frame.sharers.back();
+                frame.sharers.pop_back();
+                break;
+            }
+        }
+    }
+    merge_referenced_modified(reversed_map(f), leaving);
+    return false;
+}
+
+/// Take `HUGE_PAGES` aligned free frames off the free list
+bool take_free_group(unsigned int& head) {
+    if (free_frames.size() < HUGE_PAGES) return false;
+    unsigned int home = home_node(CURRENT_PID);
+    for (unsigned int g = 0; g + HUGE_PAGES <= NUM_FRAMES; g += HUGE_PAGES) {
+        if (NUMA_POLICY == 'b' && (frame_table[g].node != home
+                                   || frame_table[g+HUGE_PAGES-1].node != home)) continue;
+        unsigned int i = 0;
+        while (i < HUGE_PAGES && !frame_table[g+i].mapped) i++;
+        if (i < HUGE_PAGES) continue;
+        free_frames.take_range(g, g + HUGE_PAGES);
+        head = g;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Take a free frame on the node the NUMA policy picks: the home node of the
+ * current process first, or the next node in turn when interleaving. A bound
+ * process only takes frames on its home node.
+ */
+bool take_free_frame(unsigned int& f) {
+    Process& proc = current_process();
+    unsigned int node = NUMA_POLICY == 'i' ? proc.next_node : home_node(CURRENT_PID);
+    if (!free_frames.take(node, NUMA_POLICY == 'b', f)) return false;
+    proc.next_node = (frame_table[f].node + 1) % NUMA_NODES;
+    return true;
+}
+
+/**
+ * @param[in,out] huge whether an aligned group of frames is wanted for the
+ *     huge page around `vpage`, and whether one was found: a free group, or
+ *     the frames of an evicted huge page. Otherwise a single frame is taken.
+ * @return the (first) frame
+ */
+template <typename P, bool TRACE>
+unsigned int allocate_frame(unsigned int vpage, bool& huge) {
     unsigned int f;
-    if (!free_frames.empty()) {
-        f = free_frames.front();
-        free_frames.pop_front();
+    if (huge && take_free_group(f)) {
+        vpage -= vpage % HUGE_PAGES;
+    }
+    else if (take_free_frame(f)) {
+        huge = false;
     }
     else {
-        f = ::pager->select_victim_frame();
-        unsigned int pid_rv = frame_table[f].pid_rv;
-        unsigned int vpage_rv = frame_table[f].vpage_rv;
-        if (OPTION_O) {
-            cout << " UNMAP " << pid_rv << ":" << vpage_rv << endl;
-        }
-        Process& process_rv = process_pool[pid_rv];
-        process_rv.unmaps++;
-        COST += COST_TABLE::UNMAPS;
-        PTE& pte_rv = process_pool[pid_rv].page_table[vpage_rv];
-        pte_rv.present = false;
-        if (pte_rv.modified) {
-            pte_rv.paged_out = !pte_rv.file_mapped;
-            if (OPTION_O) {
-                cout << (pte_rv.file_mapped ? " FOUT" : " OUT") << endl;
-            }
-            (pte_rv.file_mapped ? process_rv.fouts : process_rv.outs)++;
-            COST += (pte_rv.file_mapped ? COST_TABLE::FOUTS
-                                          : COST_TABLE::OUTS);
-        }
-    }
-    frame_table[f].pid_rv = CURRENT_PID;
-    frame_table[f].vpage_rv = vpage;
-    frame_table[f].mapped = true;
+        // pagers only pick mapped frames, on the home node of a bound process
+        f = the_pager<P>().P::select_victim_frame();
+        if (frame_table[f].tail) {
+            f -= f % HUGE_PAGES;
+        }
+        bool unit = evict_frame<TRACE>(f);
+        for (unsigned int i = 1; unit && !huge && i < HUGE_PAGES; i++) {
+            frame_table[f+i].mapped = false;
+            frame_table[f+i].tail = false;
+            free_frames.push_back(f+i);
+        }
+        huge = huge && unit;
+        if (huge) {
+            vpage -= vpage % HUGE_PAGES;
+        }
+    }
+    for (unsigned int i = 0; i < (huge ? HUGE_PAGES : 1); i++) {
+        frame_table[f+i].pid_rv = CURRENT_PID;
+        frame_table[f+i].vpage_rv = vpage+i;
+        frame_table[f+i].mapped = true;
+        frame_table[f+i].tail = i > 0;
+        frame_table[f+i].cleaned = false;
+    }
     return f;
 }
 
-void page_fault_handler(PTE& pte, unsigned int vpage) {
-    // determine that the `vpage` can be accessed
-    if (!pte.vma_checked) {
-        pte.vma_checked = true;
-        for (VMA& vma : current_process().vmas) {
-            if (vpage >= vma.start_vpage && vpage <= vma.end_vpage) {
-                pte.vma_valid = true;
-                pte.file_mapped = vma.file_mapped;
-                pte.write_protect = vma.write_protect;
-                break;
+/**
+ * With `-H` a fault in an aligned region of `HUGE_PAGES` vpages is promoted
+ * to a huge page if the region lies within one VMA and none of its base pages
+ * is resident. A huge page is evicted as a unit; if it faults back in when no
+ * aligned frames can be had, its region is demoted to base pages.
+ */
+bool promotable(Process& proc, unsigned int head) {
+    if (HUGE_PAGES == 1) return false;
+    const VMA* vma = proc.find_vma(head);
+    bool inside = vma && head + HUGE_PAGES - 1 <= vma->end_vpage && vma->file < 0;
+    for (unsigned int i = 0; inside && i < HUGE_PAGES; i++) {
+        inside = !proc.page_table[head+i].present;
+    }
+    return inside;
+}
+
+/// Map the region starting at `head` into the frames starting at `frame`
+template <typename P, bool TRACE>
+void map_huge(Process& proc, unsigned int head, unsigned int frame) {
+    bool zero = false;
+    for (unsigned int i = 0; i < HUGE_PAGES; i++) {
+        PTE& pte = proc.page_table[head+i];
+        if (pte.paged_out) {
+            if (TRACE && OPTION_O) {
+                cout << " IN" << endl;
             }
+            proc.count(head+i).ins++;
+            if (::swap_device) {
+                COST += ::swap_device->read(CURRENT_PID, head+i, COST);
+            }
+            else {
+                COST += COST_TABLE::INS;
+            }
+        }
+        else if (pte.file_mapped) {
+            if (TRACE && OPTION_O) {
+                cout << " FIN" << endl;
+            }
+            proc.count(head+i).fins++;
+            COST += COST_TABLE::FINS;
         }
+        else {
+            zero = true;
+        }
+        pte.referenced = pte.modified = false;
+        pte.huge = true;
+        pte.frame = frame+i;
+        pte.present = true;
+        proc.resident.insert(head+i);
     }
-    if (pte.vma_valid) {
+    // the whole frame is cleared at once, however many base pages need it
+    if (zero) {
+        if (TRACE && OPTION_O) {
+            cout << " HZERO" << endl;
+        }
+        proc.huge_zeros++;
+        COST += COST_TABLE::HUGE_ZEROS;
+    }
+    if (TRACE && OPTION_O) {
+        cout << " HMAP " << frame << endl;
+    }
+    proc.huge_maps++;
+    COST += COST_TABLE::HUGE_MAPS;
+    the_pager<P>().P::age_operation(frame);
+}
+
+/**
+ * Map `vpage` of the current process to the frame holding `file_page`, if
+ * another process has that page of the file resident. Under `-m` the frame may
+ * be evicted between the lookup and taking its lock; then the lookup is
+ * repeated.
+ *
+ * @param[out] frame the frame mapped
+ * @return whether the page was in the page cache
+ */
+bool map_cached(unsigned int vpage, long file_page, unsigned int& frame) {
+    while (true) {
+        {
+            auto cache_guard = lock_cache();
+            auto cached = page_cache.find(file_page);
+            if (cached == page_cache.end()) return false;
+            frame = cached->second;
+        }
+        auto frame_guard = lock_frame(frame);
+        if (frame_table[frame].file_page != file_page) continue;
+        PTE& pte = current_process().page_table[vpage];
         pte.present = true;
-        pte.frame = allocate_frame(vpage);
+        pte.modified = false;
+        pte.frame = frame;
+        pte.cow = false;
+        current_process().resident.insert(vpage);
+        add_owner(frame, CURRENT_PID, vpage);
+        return true;
+    }
+}
+
+/**
+ * Under `-m` the pager lock is held only to pick a frame and tell the pager.
+ * A page another process has resident is mapped under its frame's lock
+ * alone, and a newly mapped frame is accounted for under its own lock.
+ */
+template <typename P, bool TRACE>
+void page_fault_handler(unsigned int vpage) {
+    PTE& pte = current_process().page_table[vpage];
+    const VMA* vma = current_process().find_vma(vpage);
+    if (vma) {
+        // page cache key of a shared file page
+        long file_page = vma->file < 0 ? -1 :
+                         static_cast<long>(vma->file) * MAX_VPAGE + vpage - vma->start_vpage;
+        unique_lock<mutex> pager_guard;
+        unsigned int frame;
+        bool cached = file_page >= 0 && map_cached(vpage, file_page, frame);
+        if (!cached && file_page >= 0 && NUM_CPUS > 1) {
+            // another CPU may bring the page in before this one gets the pager
+            pager_guard = lock_pager();
+            cached = map_cached(vpage, file_page, frame);
+        }
+        if (cached) {
+            // another process has this page of the file resident
+            if (TRACE && OPTION_O) {
+                cout << " MAP " << frame << endl;
+            }
+            current_process().count(vpage).maps++;
+            current_process().shared_maps++;
+            COST += COST_TABLE::MAPS;
+            if (!pager_guard) {
+                pager_guard = lock_pager();
+            }
+            the_pager<P>().P::reference_operation(frame);
+            return;
+        }
+        if (!pager_guard) {
+            pager_guard = lock_pager();
+        }
+        unsigned int head = vpage - vpage % HUGE_PAGES;
+        bool huge = promotable(current_process(), head);
+        frame = allocate_frame<P, TRACE>(vpage, huge);
+        if (huge) {
+            map_huge<P, TRACE>(current_process(), head, frame);
+            return;
+        }
+        if (pte.huge) {
+            for (unsigned int i = 0; i < HUGE_PAGES; i++) {
+                current_process().page_table[head+i].huge = false;
+            }
+            current_process().demotions++;
+        }
+        pte.present = true;
+        pte.modified = false;
+        pte.frame = frame;
+        pte.cow = false;
+        current_process().resident.insert(vpage);
+        if (file_page >= 0) {
+            auto frame_guard = lock_frame(frame);
+            auto cache_guard = lock_cache();
+            page_cache[file_page] = frame;
+            frame_table[frame].file_page = file_page;
+        }
+        the_pager<P>().P::age_operation(frame);
+        // the page stays put while it is accounted for, the pager is free
+        auto frame_guard = lock_frame(frame);
+        if (pager_guard) {
+            pager_guard.unlock();
+        }
         if (pte.paged_out) {
-            if (OPTION_O) {
+            if (TRACE && OPTION_O) {
                 cout << " IN" << endl;
             }
-            current_process().ins++;
-            COST += COST_TABLE::INS;
+            current_process().count(vpage).ins++;
+            if (::swap_device) {
+                COST += ::swap_device->read(CURRENT_PID, vpage, COST);
+            }
+            else {
+                COST += COST_TABLE::INS;
+            }
         }
         else if (pte.file_mapped) {
-            if (OPTION_O) {
+            if (TRACE && OPTION_O) {
                 cout << " FIN" << endl;
             }
-            current_process().fins++;
+            current_process().count(vpage).fins++;
             COST += COST_TABLE::FINS;
         }
         else {
-            if (OPTION_O) {
+            if (TRACE && OPTION_O) {
                 cout << " ZERO" << endl;
             }
-            current_process().zeros++;
+            current_process().count(vpage).zeros++;
             COST += COST_TABLE::ZEROS;
         }
-        if (OPTION_O) {
-            cout << " MAP " << pte.frame << endl;
+        if (TRACE && OPTION_O) {
+            cout << " MAP " << frame << endl;
         }
-        current_process().maps++;
+        current_process().count(vpage).maps++;
         COST += COST_TABLE::MAPS;
-        ::pager->age_operation(pte.frame);
     }
     else {
-        if (OPTION_O) {
+        if (TRACE && OPTION_O) {
             cout << " SEGV" << endl;
         }
-        current_process().segv++;
+        current_process().count(vpage).segv++;
         COST += COST_TABLE::SEGV;
     }
 }
 
+/// Count an access to `frame` as local or remote to the current process
+inline void numa_access(unsigned int frame) {
+    if (frame_table[frame].node == home_node(CURRENT_PID)) {
+        current_process().local_accesses++;
+    }
+    else {
+        current_process().remote_accesses++;
+        COST += COST_TABLE::REMOTE_ACCESS;
+    }
+}
+
+/**
+ * Unmap every page of an exiting process and return its frames to the pool.
+ * Only the resident pages and those with swap or huge page state left are
+ * visited, in vpage order.
+ */
+template <typename P, bool TRACE>
+void exit_process(unsigned int pid) {
+    Process& proc = process_pool[pid];
+    vector<unsigned int> freed;
+    proc.resident.for_each_union(proc.stale, [&](unsigned int i) {
+        PTE& pte = proc.page_table[i];
+        pte.paged_out = false;
+        if (pte.present && pte.huge && i % HUGE_PAGES) {
+            pte.present = false;
+        }
+        else if (pte.present && pte.huge) {
+            // the first vpage frees the whole huge page
+            pte.present = false;
+            if (TRACE && OPTION_O) {
+                cout << " HUNMAP " << pid << ":" << i << endl;
+            }
+            proc.huge_unmaps++;
+            COST += COST_TABLE::HUGE_UNMAPS;
+            the_pager<P>().P::release_frame(pte.frame);
+            for (unsigned int j = 0; j < HUGE_PAGES; j++) {
+                frame_table[pte.frame+j].mapped = false;
+                frame_table[pte.frame+j].tail = false;
+                freed.push_back(pte.frame+j);
+                if (pte.file_mapped && pte.modified) {
+                    if (TRACE && OPTION_O) {
+                        cout << " FOUT" << endl;
+                    }
+                    proc.count(i).fouts++;
+                    COST += COST_TABLE::FOUTS;
+                }
+            }
+        }
+        // a shared frame stays with the other processes mapping it
+        else if (pte.present) {
+            pte.present = false;
+            if (TRACE && OPTION_O) {
+                cout << " UNMAP " << pid << ":" << i << endl;
+            }
+            proc.count(i).unmaps++;
+            COST += COST_TABLE::UNMAPS;
+            auto frame_guard = lock_frame(pte.frame);
+            if (remove_owner(pte.frame, pid, i)) {
+                Frame& frame = frame_table[pte.frame];
+                frame.mapped = false;
+                if (frame.file_page >= 0) {
+                    auto cache_guard = lock_cache();
+                    page_cache.erase(frame.file_page);
+                    frame.file_page = -1;
+                }
+                if (frame_guard) {
+                    frame_guard.unlock();
+                }
+                the_pager<P>().P::release_frame(pte.frame);
+                freed.push_back(pte.frame);
+                if (pte.file_mapped && pte.modified) {
+                    if (TRACE && OPTION_O) {
+                        cout << " FOUT" << endl;
+                    }
+                    proc.count(i).fouts++;
+                    COST += COST_TABLE::FOUTS;
+                }
+            }
+        }
+        pte.huge = false;
+        pte.cow = false;
+    });
+    proc.resident.clear();
+    proc.stale.clear();
+    if (::swap_device) {
+        ::swap_device->exited(pid);
+    }
+    free_frames.append(freed);
+}
+
+/**
+ * Duplicate the current process as `child`. Resident base pages are shared:
+ * anonymous ones copy-on-write, file-mapped ones like a shared mapping.
+ * Huge pages are not shared, the child faults those in on its own.
+ */
+template <bool TRACE>
+void fork_process(unsigned int child) {
+    if (TRACE && OPTION_O) {
+        cout << " FORK " << child << endl;
+    }
+    SHARING = true;
+    process_pool.push_back(Process());
+    Process& parent = current_process();
+    Process& proc = process_pool[child];
+    proc.vmas = parent.vmas;
+    proc.vma_index = parent.vma_index;
+    proc.counters.assign(parent.counters.size(), Counters());
+    parent.forks++;
+    COST += COST_TABLE::FORKS;
+    for (size_t i = 0; i < parent.page_table.size(); i++) {
+        PTE& pte = parent.page_table[i];
+        PTE& copy = proc.page_table[i];
+        copy = pte;
+        copy.referenced = false;
+        if (pte.present && pte.huge) {
+            copy.present = copy.huge = copy.modified = false;
+        }
+        else if (pte.present) {
+            pte.cow = copy.cow = !pte.file_mapped;
+            add_owner(pte.frame, child, i);
+            proc.shared_maps++;
+            proc.resident.insert(i);
+        }
+        if (copy.paged_out || copy.huge) {
+            proc.stale.insert(i);
+        }
+    }
+    // the parent's pages just lost write access
+    if (::tlb) {
+        ::tlb->invalidate(CURRENT_PID);
+    }
+}
+
+/**
+ * First write to a copy-on-write page: copy it into a frame of its own unless
+ * every other sharer has let go of it already
+ */
+template <typename P, bool TRACE>
+void cow_fault(unsigned int vpage) {
+    PTE& pte = current_process().page_table[vpage];
+    pte.cow = false;
+    if (remove_owner(pte.frame, CURRENT_PID, vpage)) return;
+    bool huge = false;
+    pte.frame = allocate_frame<P, TRACE>(vpage, huge);
+    if (TRACE && OPTION_O) {
+        cout << " COW" << endl;
+        cout << " MAP " << pte.frame << endl;
+    }
+    current_process().cow_copies++;
+    current_process().count(vpage).maps++;
+    COST += COST_TABLE::COW_COPIES + COST_TABLE::MAPS;
+    pte.modified = false;
+    the_pager<P>().P::age_operation(pte.frame);
+}
+
+/// Whether a pool of `frames` frames leaves every NUMA node one of its own
+bool covers_nodes(unsigned int frames) {
+    vector<bool> seen(NUMA_NODES, false);
+    unsigned int nodes = 0;
+    for (unsigned int f = 0; f < frames && nodes < NUMA_NODES; f++) {
+        // frames a balloon adds are spread over the nodes in turn
+        unsigned int node = f < NUM_FRAMES ? frame_table[f].node : f % NUMA_NODES;
+        if (!seen[node]) {
+            seen[node] = true;
+            nodes++;
+        }
+    }
+    return nodes == NUMA_NODES;
+}
+
+/**
+ * Move the base page held in `from` to the free frame `to`, repointing every
+ * process on its rmap chain
+ */
+template <typename P, bool TRACE>
+void move_frame(unsigned int from, unsigned int to) {
+    if (TRACE && OPTION_O) {
+        cout << " MOVE " << from << " " << to << endl;
+    }
+    Frame& frame = frame_table[to];
+    unsigned char node = frame.node;
+    frame = frame_table[from];
+    frame.node = node;
+    auto repoint = [&](unsigned int pid, unsigned int vpage) {
+        process_pool[pid].page_table[vpage].frame = to;
+        if (::tlb) {
+            ::tlb->invalidate(pid, vpage);
+        }
+    };
+    repoint(frame.pid_rv, frame.vpage_rv);
+    for (const Mapping& m : frame.sharers) {
+        repoint(m.pid, m.vpage);
+    }
+    if (frame.file_page >= 0) {
+        page_cache[frame.file_page] = to;
+    }
+    the_pager<P>().P::move_frame(from, to);
+    if (::swap_device && frame_modified(to)) {
+        ::swap_device->dirtied(to);
+    }
+    COST += COST_TABLE::PAGE_MOVES;
+    
+    frame_table[from].mapped = false;
+    frame_table[from].sharers.clear();
+    frame_table[from].file_page = -1;
+}
+
+/**
+ * Resize the frame pool to `frames`, as a balloon driver or a changed memory
+ * limit would. Shrinking moves the base pages held in the frames that go into
+ * free frames below the new end, after the pager evicted enough pages to make
+ * room. A huge page reaching past the new end is evicted as a whole, since it
+ * needs an aligned group. Frames added are free and spread over the NUMA nodes
+ * in turn.
+ */
+template <typename P, bool TRACE>
+void balloon(unsigned int frames) {
+    // evict `head` and free its frames below the new end
+    auto release = [&](unsigned int head) {
+        unsigned int pages = evict_frame<TRACE>(head) ? HUGE_PAGES : 1;
+        the_pager<P>().P::release_frame(head);
+        for (unsigned int i = 0; i < pages; i++) {
+            frame_table[head+i].mapped = false;
+            frame_table[head+i].tail = false;
+            if (head+i < frames) {
+                free_frames.push_back(head+i);
+            }
+        }
+    };
+    
+    size_t moving = 0;
+    for (unsigned int f = frames; f < NUM_FRAMES; f++) {
+        if (!frame_table[f].mapped) continue;
+        if (frame_table[f].tail || snapshot(reversed_map(f)).huge) {
+            release(frame_table[f].tail ? f - f % HUGE_PAGES : f);
+        }
+        else {
+            moving++;
+        }
+    }
+    free_frames.take_range(frames, NUM_FRAMES);
+    // the pool, not the current process, needs the room: bind does not apply
+    char policy = NUMA_POLICY;
+    NUMA_POLICY = 'l';
+    while (free_frames.size() < moving) {
+        unsigned int victim = the_pager<P>().P::select_victim_frame();
+        // a pager may still hold a tail of a huge page freed above
+        if (!frame_table[victim].mapped) continue;
+        if (frame_table[victim].tail) {
+            victim -= victim % HUGE_PAGES;
+        }
+        moving -= victim >= frames;
+        release(victim);
+    }
+    NUMA_POLICY = policy;
+    for (unsigned int f = frames; f < NUM_FRAMES; f++) {
+        if (!frame_table[f].mapped) continue;
+        unsigned int to;
+        if (!free_frames.take(frame_table[f].node, false, to)) {
+            // no room left below the end: the page goes out instead
+            release(f);
+            continue;
+        }
+        move_frame<P, TRACE>(f, to);
+    }
+    
+    unsigned int old = NUM_FRAMES;
+    frame_table.resize(frames);
+    NUM_FRAMES = frames;
+    for (unsigned int f = old; f < frames; f++) {
+        frame_table[f].node = f % NUMA_NODES;
+        free_frames.push_back(f);
+    }
+    the_pager<P>().P::resize(frames);
+}
+
+template <typename P, bool TRACE>
 void simulation(InstructionLoader& loader) {
-    loader.initialize_process();
     char operation;
     int operand;
     while ( loader.get_next_instruction(operation, operand) ) {
-        if (OPTION_O) {
+        if (TRACE && OPTION_O) {
             cout << INSTR_COUNT << ": ==> "
                  << operation << " "
                  << operand << endl;
         }
+        if (::sampler && INSTR_COUNT == ::sampler->next) {
+            ::sampler->sample(INSTR_COUNT);
+        }
+        if (::swap_device) {
+            ::swap_device->tick(COST);
+        }
         switch (operation) {
             case 'w':
             case 'r': {
-                PTE& pte = current_process().page_table[operand];
-                pte.referenced = true;
+                PTE* pte = &page_entry(current_process(), operand);
+                if (pte->present && !pte->referenced) {
+                    the_pager<P>().P::reference_operation(pte->frame);
+                }
+                pte->referenced = true;
                 COST += COST_TABLE::READ_WRITE;
-                if (!pte.present) {
-                    pte.modified = false;
-                    page_fault_handler(pte, operand);
+                bool tlb_miss = false;
+                if (::tlb) {
+                    if (::tlb->lookup(CURRENT_PID, tlb_page(*pte, operand))) {
+                        current_process().tlb_hits++;
+                        COST += COST_TABLE::TLB_HITS;
+                    }
+                    else {
+                        tlb_miss = true;
+                        current_process().tlb_misses++;
+                        COST += COST_TABLE::TLB_MISSES;
+                    }
                 }
-                if (operation == 'w' && pte.write_protect) {
-                    if (OPTION_O) {
+                if (!pte->present) {
+                    pte->modified = false;
+                    page_fault_handler<P, TRACE>(operand);
+                    pte = &page_entry(current_process(), operand);
+                    pte->referenced = true;
+                }
+                if (tlb_miss && pte->present) {
+                    ::tlb->insert(CURRENT_PID, tlb_page(*pte, operand));
+                }
+                if (NUMA_NODES > 1 && pte->present) {
+                    numa_access(pte->frame);
+                }
+                if (operation == 'w' && pte->write_protect) {
+                    if (TRACE && OPTION_O) {
                         cout << " SEGPROT" << endl;
                     }
-                    current_process().segprot++;
+                    current_process().count(operand).segprot++;
                     COST += COST_TABLE::SEGPROT;
                 }
                 else {
-                    pte.modified |= operation=='w';
+                    if (operation == 'w' && pte->cow) {
+                        cow_fault<P, TRACE>(operand);
+                    }
+                    if (::swap_device && operation == 'w' && !pte->modified) {
+                        ::swap_device->dirtied(pte->frame);
+                    }
+                    pte->modified |= operation=='w';
                 }
                 
-                if (OPTION_y && pte.vma_valid) {
+                bool valid = TRACE && current_process().find_vma(operand);
+                if (OPTION_y && valid) {
                     for (size_t i = 0; i < process_pool.size(); i++) {
                         Process& proc = process_pool[i];
                         cout << "PT[" << i << "]: " << proc.page_table << endl;
                     }
                 }
-                else if (OPTION_x && pte.vma_valid) {
+                else if (OPTION_x && valid) {
                     cout << "PT[" << CURRENT_PID << "]: "
                          << current_process().page_table << endl;
                 }
-                if (OPTION_f && pte.vma_valid) {
+                if (OPTION_f && valid) {
                     cout << "FT: " << frame_table << endl;
                 }
                 break;
@@ -154,44 +879,171 @@ void simulation(InstructionLoader& loader) {
                 CTX_SWITCHES++;
                 CURRENT_PID = operand;
                 COST += COST_TABLE::SWITCHES;
+                if (::tlb) {
+                    ::tlb->context_switch();
+                }
+                break;
+            }
+            case 'f': {
+                if (static_cast<size_t>(operand) != process_pool.size()) {
+                    cerr << "Fork must create process " << process_pool.size()
+                         << ", not " << operand << "." << endl;
+                    break;
+                }
+                if (process_pool.size() >= (1u << 16)) {
+                    cerr << "Fork cannot create more than " << (1u << 16)
+                         << " processes." << endl;
+                    break;
+                }
+                fork_process<TRACE>(operand);
+                break;
+            }
+            case 'b': {
+                if (operand < 1 || operand > (1 << 24)) {
+                    cerr << "Frame pool must keep between 1 and " << (1 << 24)
+                         << " frames, not " << operand << "." << endl;
+                    break;
+                }
+                if (!covers_nodes(operand)) {
+                    cerr << "Frame pool of " << operand << " frames leaves a NUMA node"
+                         << " without memory." << endl;
+                    break;
+                }
+                balloon<P, TRACE>(operand);
                 break;
             }
             case 'e': {
                 cout << "EXIT current process " << operand << endl;
                 PROCESS_EXITS++;
                 COST += COST_TABLE::EXITS;
-                Process& proc = process_pool[operand];
-                for (size_t i = 0; i < proc.page_table.size(); i++) {
-                    PTE& pte = proc.page_table[i];
-                    pte.paged_out = false;
-                    if (pte.present) {
-                        pte.present = false;
-                        if (OPTION_O) {
-                            cout << " UNMAP " << operand << ":" << i << endl;
-                        }
-                        proc.unmaps++;
-                        COST += COST_TABLE::UNMAPS;
-                        frame_table[pte.frame].mapped = false;
-                        free_frames.push_back(pte.frame);
-                        if (pte.file_mapped && pte.modified) {
-                            if (OPTION_O) {
-                                cout << " FOUT" << endl;
-                            }
-                            proc.fouts++;
-                            COST += COST_TABLE::FOUTS;
-                        }
-                    }
+                if (::tlb) {
+                    ::tlb->invalidate(operand);
                 }
+                exit_process<P, TRACE>(operand);
             }
         }
         INSTR_COUNT++;
     }
+    if (::sampler) {
+        ::sampler->sample(INSTR_COUNT);
+    }
+}
+
+/**
+ * Replay one CPU's trace. Hits only update the PTE word atomically. Picking a
+ * frame, exits and pager notifications serialize on `fault_lock`; mapping
+ * takes the frame's lock. A process must not run on two CPUs at once.
+ */
+template <typename P>
+void run_cpu(Cpu& cpu) {
+    this_cpu = &cpu;
+    ::tlb = cpu.tlb;
+    CURRENT_PID = cpu.pid;
+    
+    for (const Instruction& instr : cpu.trace) {
+        switch (instr.operation) {
+            case 'w':
+            case 'r': {
+                bool write = instr.operation == 'w';
+                PTE* pte = &page_entry(current_process(), instr.operand);
+                COST += COST_TABLE::READ_WRITE;
+                bool tlb_miss = false;
+                if (::tlb) {
+                    lock_guard<mutex> guard(cpu.tlb_lock);
+                    tlb_miss = !::tlb->lookup(CURRENT_PID, tlb_page(snapshot(*pte), instr.operand));
+                }
+                if (::tlb && tlb_miss) {
+                    current_process().tlb_misses++;
+                    COST += COST_TABLE::TLB_MISSES;
+                }
+                else if (::tlb) {
+                    current_process().tlb_hits++;
+                    COST += COST_TABLE::TLB_HITS;
+                }
+                
+                bool was_referenced = true;
+                if (!touch(*pte, write, was_referenced)) {
+                    page_fault_handler<P, false>(instr.operand);
+                    pte = &page_entry(current_process(), instr.operand);
+                    // another CPU may have evicted the page again already
+                    touch(*pte, write, was_referenced);
+                }
+                else if (!was_referenced) {
+                    auto guard = lock_pager();
+                    if (pte->present) {
+                        the_pager<P>().P::reference_operation(pte->frame);
+                    }
+                }
+                PTE now = snapshot(*pte);
+                if (tlb_miss && now.present) {
+                    lock_guard<mutex> guard(cpu.tlb_lock);
+                    ::tlb->insert(CURRENT_PID, tlb_page(now, instr.operand));
+                }
+                if (NUMA_NODES > 1 && now.present) {
+                    numa_access(now.frame);
+                }
+                if (write && now.write_protect) {
+                    current_process().count(instr.operand).segprot++;
+                    COST += COST_TABLE::SEGPROT;
+                }
+                break;
+            }
+            case 'c': {
+                cpu.switches++;
+                CURRENT_PID = instr.operand;
+                cpu.pid = instr.operand;
+                COST += COST_TABLE::SWITCHES;
+                if (::tlb) {
+                    lock_guard<mutex> guard(cpu.tlb_lock);
+                    ::tlb->context_switch();
+                }
+                break;
+            }
+            case 'e': {
+                cpu.exits++;
+                COST += COST_TABLE::EXITS;
+                if (::tlb) {
+                    lock_guard<mutex> guard(cpu.tlb_lock);
+                    ::tlb->invalidate(instr.operand);
+                }
+                auto guard = lock_pager();
+                exit_process<P, false>(instr.operand);
+                break;
+            }
+        }
+        cpu.instructions++;
+    }
+    retired += cpu.instructions - cpu.published;
+    cpu.cost = COST;
+}
+
+/**
+ * Replay the trace with the fault path instantiated for pager type `P`. The
+ * per-instruction output is compiled in only when one was asked for.
+ */
+template <typename P>
+void replay(InstructionLoader& loader) {
+    if (NUM_CPUS > 1) {
+        vector<thread> threads;
+        for (Cpu& cpu : cpus) {
+            threads.emplace_back(run_cpu<P>, ref(cpu));
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+    }
+    else if (OPTION_O || OPTION_x || OPTION_y || OPTION_f) {
+        simulation<P, true>(loader);
+    }
+    else {
+        simulation<P, false>(loader);
+    }
 }
 
 bool cmd_option(int& argc, char* const argv[], char& algo) {
     opterr = 0;
     int o;
-    while ((o = getopt(argc, argv, "f:a:o:")) != -1) {
+    while ((o = getopt(argc, argv, "f:a:o:t:pm:H:s:i:N:")) != -1) {
         switch (o) {
             case 'f':
                 NUM_FRAMES = stoi(optarg);
@@ -199,6 +1051,119 @@ bool cmd_option(int& argc, char* const argv[], char& algo) {
             case 'a':
                 algo = string(optarg)[0];
                 break;
+            case 'p':
+                ::PROFILE = true;
+                break;
+            case 'm':
+                NUM_CPUS = stoi(optarg);
+                break;
+            case 'H':
+                HUGE_PAGES = stoi(optarg);
+                if (HUGE_PAGES == 0 || HUGE_PAGES > MAX_VPAGE
+                    || (HUGE_PAGES & (HUGE_PAGES-1))) {
+                    cerr << "Huge page size must be a power of two up to "
+                         << MAX_VPAGE << " vpages." << endl;
+                    return true;
+                }
+                break;
+            case 't': {
+                // -t<entries>[:<ways>[:<flags>]], flags: a|f (ASID tagged or
+                // flush on `c`), l|r (LRU or random replacement)
+                string spec = string(optarg);
+                stringstream ss(spec);
+                string field;
+                getline(ss, field, ':');
+                TLB_ENTRIES = stoi(field);
+                if (getline(ss, field, ':')) {
+                    ::TLB_WAYS = stoi(field);
+                }
+                if (getline(ss, field, ':')) {
+                    for (char& c : field) {
+                        switch (c) {
+                            case 'a': ::TLB_ASID = true; break;
+                            case 'f': ::TLB_ASID = false; break;
+                            case 'l': ::TLB_LRU = true; break;
+                            case 'r': ::TLB_LRU = false; break;
+                            default:
+                                cerr << "Unknown TLB option: `" << c
+                                     << "'." << endl;
+                                return true;
+                        }
+                    }
+                }
+                if (::TLB_WAYS == 0 || TLB_ENTRIES < ::TLB_WAYS) {
+                    cerr << "TLB needs at least one set of "
+                         << ::TLB_WAYS << " ways." << endl;
+                    return true;
+                }
+                break;
+            }
+            case 's': {
+                // -s<window>[:<flags>], flags: b|s (background write-back or
+                // synchronous writes only)
+                string spec = string(optarg);
+                stringstream ss(spec);
+                string field;
+                getline(ss, field, ':');
+                ::SWAP_MODEL = true;
+                ::SWAP_WINDOW = stoi(field);
+                if (getline(ss, field, ':')) {
+                    for (char& c : field) {
+                        switch (c) {
+                            case 'b': ::SWAP_WRITEBACK = true; break;
+                            case 's': ::SWAP_WRITEBACK = false; break;
+                            default:
+                                cerr << "Unknown swap option: `" << c
+                                     << "'." << endl;
+                                return true;
+                        }
+                    }
+                }
+                break;
+            }
+            case 'N': {
+                // -N<nodes>[:<policy>], policy: l|i|b (local-first,
+                // interleave or bind to the home node)
+                string spec = string(optarg);
+                stringstream ss(spec);
+                string field;
+                getline(ss, field, ':');
+                NUMA_NODES = stoi(field);
+                if (getline(ss, field, ':')) {
+                    if (field.size() != 1 || string("lib").find(field[0]) == string::npos) {
+                        cerr << "Unknown NUMA policy: `" << field << "'." << endl;
+                        return true;
+                    }
+                    NUMA_POLICY = field[0];
+                }
+                break;
+            }
+            case 'i': {
+                // -i<interval>:<file>[:c|b], CSV or binary records
+                string spec = string(optarg);
+                stringstream ss(spec);
+                string field;
+                getline(ss, field, ':');
+                ::SAMPLE_INTERVAL = stoul(field);
+                getline(ss, ::SAMPLE_FILE, ':');
+                if (getline(ss, field, ':')) {
+                    for (char& c : field) {
+                        switch (c) {
+                            case 'c': ::SAMPLE_BINARY = false; break;
+                            case 'b': ::SAMPLE_BINARY = true; break;
+                            default:
+                                cerr << "Unknown sample option: `" << c
+                                     << "'." << endl;
+                                return true;
+                        }
+                    }
+                }
+                if (::SAMPLE_INTERVAL == 0 || ::SAMPLE_FILE.empty()) {
+                    cerr << "Sampling needs an interval and a file." << endl;
+                    return true;
+                }
+                break;
+            }
             case 'o': {
                 string opt = string(optarg);
                 for (char& c : opt) {
@@ -236,7 +1201,9 @@ bool cmd_option(int& argc, char* const argv[], char& algo) {
                 break;
             }
             case '?':
-                if (optopt == 'f' || optopt == 'a' || optopt == 'o')
+                if (optopt == 'f' || optopt == 'a' || optopt == 'o' || optopt == 't'
+                    || optopt == 'm' || optopt == 'H' || optopt == 's'
+                    || optopt == 'i' || optopt == 'N')
                     cerr << "Option -" << char(optopt)
                          << "requires an argument." << endl;
                 else if (isprint (optopt))
@@ -260,43 +1227,156 @@ int main(int argc, char* const argv[]) {
     }
     argc -= optind;
     argv += optind;
-    if (argc < 2) {
+    if (argc < (PROFILE ? 1 : 2)) {
         cerr << "Both input file and rfile are required." << endl;
         return 1;
     }
     
     InstructionLoader loader(argv[0]);
+    loader.initialize_process();
+    
+    if (PROFILE) {
+        ReuseProfiler profiler;
+        profiler.run(loader);
+        profiler.print(cout);
+        return 0;
+    }
+
+    if (NUM_CPUS > 1) {
+        if (algo == 'o') {
+            cerr << "OPT cannot replay a multi-CPU trace." << endl;
+            return 1;
+        }
+        if (SWAP_MODEL) {
+            cerr << "The swap device is only modelled on one CPU." << endl;
+            return 1;
+        }
+        if (SAMPLE_INTERVAL) {
+            cerr << "Sampling is only done on one CPU." << endl;
+            return 1;
+        }
+        // interleaved per-instruction output would be meaningless
+        OPTION_O = OPTION_x = OPTION_y = OPTION_f = OPTION_a = false;
+    }
 
+    if (NUMA_NODES == 0 || NUMA_NODES > min(NUM_FRAMES, 255u)) {
+        cerr << "Need between 1 and " << min(NUM_FRAMES, 255u)
+             << " NUMA nodes." << endl;
+        return 1;
+    }
+    // nodes own equal contiguous ranges of frames
+    free_frames.resize(NUMA_NODES);
     for (unsigned int i = 0; i < NUM_FRAMES; i++) {
         frame_table.push_back(Frame());
+        frame_table.back().node = static_cast<unsigned long>(i) * NUMA_NODES / NUM_FRAMES;
         free_frames.push_back(i);
     }
     
+    if (NUM_CPUS > 1) {
+        frame_locks = vector<mutex>(NUM_FRAMES);
+        for (unsigned int i = 0; i < NUM_CPUS; i++) {
+            cpus.emplace_back();
+            if (TLB_ENTRIES) {
+                cpus.back().tlb = new TLB(TLB_ENTRIES, TLB_WAYS, TLB_ASID, TLB_LRU, argv[1]);
+            }
+        }
+        unsigned int cpu;
+        char operation;
+        int operand;
+        while (loader.get_next_instruction(cpu, operation, operand)) {
+            if (cpu >= NUM_CPUS) {
+                cerr << "Instruction for unknown CPU " << cpu << "." << endl;
+                return 1;
+            }
+            if (operation == 'f' || operation == 'b') {
+                cerr << (operation == 'f' ? "Fork" : "Balloon")
+                     << " cannot be replayed on several CPUs." << endl;
+                return 1;
+            }
+            // a CPU starts out running the process its trace switches to first
+            if (cpus[cpu].trace.empty() && operation == 'c') {
+                cpus[cpu].pid = operand;
+            }
+            cpus[cpu].trace.push_back(Instruction{operation, operand});
+        }
+    }
+    else {
+        if (TLB_ENTRIES) {
+            ::tlb = new TLB(TLB_ENTRIES, TLB_WAYS, TLB_ASID, TLB_LRU, argv[1]);
+        }
+        if (SWAP_MODEL) {
+            ::swap_device = new SwapDevice(SWAP_WINDOW, SWAP_WRITEBACK);
+        }
+        if (SAMPLE_INTERVAL) {
+            ::sampler = new Sampler(SAMPLE_INTERVAL, SAMPLE_FILE, SAMPLE_BINARY);
+            if (!::sampler->good()) {
+                cerr << "Cannot write samples to `" << SAMPLE_FILE << "'." << endl;
+                return 1;
+            }
+        }
+    }
+    
     switch (algo) {
         case 'f':
             ::pager = new FifoPager(OPTION_a);
+            replay<FifoPager>(loader);
             break;
         case 'c':
             ::pager = new ClockPager(OPTION_a);
+            replay<ClockPager>(loader);
             break;
         case 'a':
             ::pager = new AgingPager(OPTION_a);
+            replay<AgingPager>(loader);
             break;
         case 'e':
             ::pager = new EscPager(OPTION_a);
+            replay<EscPager>(loader);
             break;
         case 'w':
             ::pager = new WorkingSetPager(OPTION_a);
+            replay<WorkingSetPager>(loader);
             break;
         case 'r':
             ::pager = new RandomPager(OPTION_a, argv[1]);
+            replay<RandomPager>(loader);
+            break;
+        case 'A':
+            ::pager = new ArcPager(OPTION_a);
+            replay<ArcPager>(loader);
+            break;
+        case 'p':
+            ::pager = new ClockProPager(OPTION_a);
+            replay<ClockProPager>(loader);
+            break;
+        case 'n':
+            ::pager = new HomeNodePager<FifoPager>(OPTION_a);
+            replay<HomeNodePager<FifoPager>>(loader);
+            break;
+        case 'N':
+            ::pager = new HomeNodePager<ClockPager>(OPTION_a);
+            replay<HomeNodePager<ClockPager>>(loader);
+            break;
+        case 'o':
+            ::pager = new OptPager(OPTION_a, loader.buffer_instructions());
+            replay<OptPager>(loader);
             break;
         default:
             cerr << "Unknown paging alogrithm: `" << algo << "'." << endl;
             return 1;
     }
     
-    simulation(loader);
+    if (NUM_CPUS > 1) {
+        INSTR_COUNT = retired;
+        for (Cpu& cpu : cpus) {
+            CTX_SWITCHES += cpu.switches;
+            PROCESS_EXITS += cpu.exits;
+            COST += cpu.cost;
+            delete cpu.tlb;
+        }
+    }
+    delete ::tlb;
+    delete ::sampler;
     delete ::pager;
     
     if (OPTION_P) {
@@ -315,6 +1395,23 @@ int main(int argc, char* const argv[]) {
             Process& proc = process_pool[i];
             cout << "PROC[" << i << "]:" << proc << endl;
         }
+        for (size_t i = 0; i < cpus.size(); i++) {
+            cout << "CPU[" << i << "]: I=" << cpus[i].instructions
+                 << " C=" << cpus[i].switches
+                 << " E=" << cpus[i].exits
+                 << " SD=" << cpus[i].shootdowns << endl;
+        }
+        if (::swap_device) {
+            cout << *::swap_device << endl;
+        }
+        if (NUMA_NODES > 1) {
+            unsigned long local = 0, remote = 0;
+            for (const Process& proc : process_pool) {
+                local += proc.local_accesses;
+                remote += proc.remote_accesses;
+            }
+            cout << "NUMA: L=" << local << " R=" << remote << endl;
+        }
 
         cout << "TOTALCOST " << INSTR_COUNT << " "
                              << CTX_SWITCHES << " "
@@ -8,6 +8,14 @@
 #include <algorithm>
 #include <vector>
 #include <queue>
+#include <list>
+#include <unordered_map>
+#include <climits>
+#include <cstdint>
+#include <set>
+#include <map>
+#include <cstring>
+#include <mutex>
 
 using namespace std;
 
@@ -15,18 +23,27 @@ namespace mmu {
 
 unsigned int        MAX_VPAGE       = 64;
 unsigned int        NUM_FRAMES      = 4;
-unsigned int        CURRENT_PID     = 0;
+thread_local unsigned int CURRENT_PID = 0;
 unsigned long       INSTR_COUNT     = 0;
 unsigned long       CTX_SWITCHES    = 0;
 unsigned long       PROCESS_EXITS   = 0;
-unsigned long long  COST            = 0;
+thread_local unsigned long long COST = 0;
+unsigned int        TLB_ENTRIES     = 0;    /// 0 disables the TLB model
+unsigned int        NUM_CPUS        = 1;
+unsigned int        HUGE_PAGES      = 1;    /// vpages per huge page, 1 disables them
+bool                SHARING         = false;/// a fork ran or a VMA maps a shared file
+unsigned int        NUMA_NODES      = 1;
+char                NUMA_POLICY     = 'l';  /// local-first, interleave or bind
 
 struct Frame;
 struct Process;
+struct Instruction;
+
+class FreeFrames;
 
 vector<Frame>       frame_table;
-deque<unsigned int> free_frames;
 vector<Process>     process_pool;
+unordered_map<unsigned long, unsigned int> page_cache;  /// shared file page -> frame
 
 enum COST_TABLE {
     READ_WRITE      = 1,
@@ -40,7 +57,18 @@ enum COST_TABLE {
     FOUTS           = 2400,
     ZEROS           = 140,
     SEGV            = 340,
-    SEGPROT         = 420
+    SEGPROT         = 420,
+    TLB_HITS        = 0,
+    TLB_MISSES      = 20,
+    SHOOTDOWNS      = 500,
+    HUGE_MAPS       = 320,
+    HUGE_UNMAPS     = 440,
+    HUGE_ZEROS      = 600,
+    FORKS           = 1800,
+    COW_COPIES      = 280,
+    PAGE_MOVES      = 280,  /// a page copied below the end of a shrinking pool
+    REMOTE_ACCESS   = 2,    /// added to READ_WRITE for a frame on another node
+    READ_AHEAD      = 300   /// each further page of a sequential swap read
 };
 
 struct PTE {
@@ -48,12 +76,11 @@ struct PTE {
     unsigned int referenced:1;
     unsigned int modified:1;
     unsigned int paged_out:1;
-    unsigned int frame:7;
-    unsigned int vma_checked:1;
-    unsigned int write_protect:1;
+    unsigned int frame:24;
+    unsigned int huge:1;            /// part of a huge page, kept after unmap
+    unsigned int cow:1;             /// shared with a forked process until written
+    unsigned int write_protect:1;   /// copied from the VMA when it is indexed
     unsigned int file_mapped:1;
-    unsigned int vma_valid:1;
-    unsigned int zeros:17;
 };
 
 struct VMA {
@@ -61,18 +88,123 @@ struct VMA {
     unsigned int end_vpage:6;
     unsigned int write_protect:1;
     unsigned int file_mapped:1;
+    int file;                       /// shared file mapped at `start_vpage`, -1 if private
+};
+
+struct Instruction {
+    char operation;
+    int operand;
+};
+
+struct Mapping {
+    unsigned int pid;
+    unsigned int vpage;
 };
 
 struct Frame {
-    unsigned int pid_rv:4;
+    unsigned int pid_rv:16;
     unsigned int vpage_rv:6;
     unsigned int mapped:1;
+    unsigned int tail:1;            /// not the first frame of a huge page
+    unsigned int cleaned:1;         /// written back in the background since mapped
     unsigned int age;
+    unsigned char node;             /// NUMA node, fixed so CPUs may read it unlocked
+    vector<Mapping> sharers;        /// rmap chain after (`pid_rv`, `vpage_rv`)
+    long file_page = -1;            /// key in `page_cache`, -1 if not cached
 };
 
-struct Process {
-    vector<VMA> vmas;
-    vector<PTE> page_table;
+/// Free frames in one FIFO per NUMA node
+class FreeFrames {
+private:
+    vector<deque<unsigned int>> lists_;
+    size_t size_ = 0;
+public:
+    FreeFrames() : lists_(1) {}
+    
+    void resize(unsigned int nodes) {
+        lists_.resize(nodes);
+    }
+    
+    size_t size() const {
+        return size_;
+    }
+    
+    bool empty() const {
+        return size_ == 0;
+    }
+    
+    void push_back(unsigned int frame);
+    
+    /// Free all of `frames` with one insert per node, sorting them by node
+    void append(vector<unsigned int>& frames);
+    
+    /**
+     * Take the oldest free frame of `node`, or with `strict` unset of the
+     * nodes after it in turn
+     *
+     * @return false if there is none
+     */
+    bool take(unsigned int node, bool strict, unsigned int& frame) {
+        for (unsigned int i = 0; i < (strict ? 1 : lists_.size()); i++) {
+            deque<unsigned int>& list = lists_[(node + i) % lists_.size()];
+            if (list.empty()) continue;
+            frame = list.front();
+            list.pop_front();
+            size_--;
+            return true;
+        }
+        return false;
+    }
+    
+    /// Take the free frames in [`first`, `last`)
+    void take_range(unsigned int first, unsigned int last) {
+        for (deque<unsigned int>& list : lists_) {
+            auto end = remove_if(list.begin(), list.end(), [=](unsigned int f) {
+                return f >= first && f < last;
+            });
+            size_ -= list.end() - end;
+            list.erase(end, list.end());
+        }
+    }
+};
+
+FreeFrames          free_frames;
+
+/// A set of vpages kept as a bitmap, so it is walked in vpage order
+class PageSet {
+private:
+    vector<unsigned long long> words_;
+public:
+    PageSet() : words_((MAX_VPAGE + 63) / 64, 0) {}
+    
+    /// Atomic, as with `-m` the pager evicts pages of processes running elsewhere
+    void insert(unsigned int vpage) {
+        __atomic_fetch_or(&words_[vpage / 64], 1ULL << (vpage % 64), __ATOMIC_RELAXED);
+    }
+    
+    void erase(unsigned int vpage) {
+        __atomic_fetch_and(&words_[vpage / 64], ~(1ULL << (vpage % 64)), __ATOMIC_RELAXED);
+    }
+    
+    void clear() {
+        fill(words_.begin(), words_.end(), 0);
+    }
+    
+    /// Call `f` on every vpage in this set or in `other`, in increasing order
+    template <typename F>
+    void for_each_union(const PageSet& other, F f) const {
+        for (size_t w = 0; w < words_.size(); w++) {
+            unsigned long long bits = words_[w] | other.words_[w];
+            while (bits) {
+                f(static_cast<unsigned int>(w * 64 + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+};
+
+/// Paging events of a process, counted per VMA
+struct Counters {
     unsigned long unmaps    = 0;
     unsigned long maps      = 0;
     unsigned long ins       = 0;
@@ -83,7 +215,98 @@ struct Process {
     unsigned long segv      = 0;
     unsigned long segprot   = 0;
     
-    Process() : page_table(MAX_VPAGE) {}
+    Counters& operator += (const Counters& other) {
+        unmaps += other.unmaps;
+        maps += other.maps;
+        ins += other.ins;
+        fins += other.fins;
+        outs += other.outs;
+        fouts += other.fouts;
+        zeros += other.zeros;
+        segv += other.segv;
+        segprot += other.segprot;
+        return *this;
+    }
+    
+    bool empty() const {
+        return !(unmaps | maps | ins | fins | outs | fouts | zeros | segv | segprot);
+    }
+};
+
+struct Process {
+    vector<VMA> vmas;               /// sorted by `start_vpage`
+    vector<int> vma_index;          /// vpage -> position in `vmas`, -1 if none
+    vector<PTE> page_table;
+    PageSet resident;               /// vpages present in a frame
+    PageSet stale;                  /// unmapped vpages that may keep swap or huge page state
+    vector<Counters> counters;      /// per VMA since the last sample, then outside any VMA
+    Counters sampled;               /// intervals already sampled
+    unsigned long tlb_hits  = 0;
+    unsigned long tlb_misses= 0;
+    unsigned long shootdowns= 0;
+    unsigned long huge_maps = 0;
+    unsigned long huge_unmaps = 0;
+    unsigned long huge_zeros= 0;
+    unsigned long demotions = 0;
+    unsigned long forks     = 0;
+    unsigned long cow_copies= 0;
+    unsigned long shared_maps = 0;
+    unsigned long local_accesses = 0;
+    unsigned long remote_accesses = 0;
+    unsigned int next_node  = 0;    /// where an interleaved allocation goes next
+    
+    Process() : vma_index(MAX_VPAGE, -1), page_table(MAX_VPAGE) {}
+    
+    /**
+     * Sort `vmas` and build `vma_index` once the address space is read, so a
+     * fault never searches the VMAs. The protection of each VMA is copied into
+     * the PTEs it covers. Where VMAs overlap, the one listed first wins.
+     */
+    void index_vmas() {
+        vector<size_t> order(vmas.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return vmas[a].start_vpage < vmas[b].start_vpage;
+        });
+        vector<VMA> sorted;
+        vector<int> position(vmas.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            sorted.push_back(vmas[order[i]]);
+            position[order[i]] = static_cast<int>(i);
+        }
+        fill(vma_index.begin(), vma_index.end(), -1);
+        for (size_t i = 0; i < vmas.size(); i++) {
+            for (unsigned int vpage = vmas[i].start_vpage;
+                 vpage <= vmas[i].end_vpage && vpage < MAX_VPAGE; vpage++) {
+                if (vma_index[vpage] >= 0) continue;
+                vma_index[vpage] = position[i];
+                page_table[vpage].write_protect = vmas[i].write_protect;
+                page_table[vpage].file_mapped = vmas[i].file_mapped;
+            }
+        }
+        vmas.swap(sorted);
+        counters.assign(vmas.size() + 1, Counters());
+    }
+    
+    /// The VMA holding `vpage`, nullptr if it lies outside every VMA
+    const VMA* find_vma(unsigned int vpage) const {
+        int i = vma_index[vpage];
+        return i < 0 ? nullptr : &vmas[i];
+    }
+    
+    /// The counters an event on `vpage` goes to
+    Counters& count(unsigned int vpage) {
+        int i = vma_index[vpage];
+        return counters[i < 0 ? vmas.size() : i];
+    }
+    
+    Counters total() const {
+        Counters sum = sampled;
+        for (const Counters& c : counters) {
+            sum += c;
+        }
+        return sum;
+    }
 };
 
 inline PTE& reversed_map(int i) {
@@ -92,10 +315,181 @@ inline PTE& reversed_map(int i) {
     return process_pool[pid_rv].page_table[vpage_rv];
 }
 
+/**
+ * With several CPUs (`-m`) a frame's rmap chain (`sharers`) and `file_page`
+ * change under the frame's own lock, so a process mapping a page that is
+ * already resident does not wait for the pager. The fields pagers scan are
+ * only written under the pager lock, which is taken before any frame lock.
+ * One CPU takes no locks.
+ */
+vector<mutex>       frame_locks;
+
+inline unique_lock<mutex> lock_frame(unsigned int frame) {
+    return NUM_CPUS > 1 ? unique_lock<mutex>(frame_locks[frame]) : unique_lock<mutex>();
+}
+
 inline Process& current_process() {
     return process_pool[CURRENT_PID];
 }
 
+inline void FreeFrames::push_back(unsigned int frame) {
+    lists_[frame_table[frame].node].push_back(frame);
+    size_++;
+}
+
+inline void FreeFrames::append(vector<unsigned int>& frames) {
+    if (lists_.size() > 1) {
+        stable_sort(frames.begin(), frames.end(), [](unsigned int a, unsigned int b) {
+            return frame_table[a].node < frame_table[b].node;
+        });
+    }
+    for (auto first = frames.begin(); first != frames.end();) {
+        unsigned char node = frame_table[*first].node;
+        auto last = find_if(first, frames.end(), [=](unsigned int f) {
+            return frame_table[f].node != node;
+        });
+        lists_[node].insert(lists_[node].end(), first, last);
+        first = last;
+    }
+    size_ += frames.size();
+}
+
+inline unsigned int home_node(unsigned int pid) {
+    return pid % NUMA_NODES;
+}
+
+/**
+ * Whether a NUMA-aware pager should rather evict `frame`. With no frame free,
+ * the faulting page goes where the victim was, so a victim on the faulting
+ * process's home node keeps it local; frames on other nodes are remote to it.
+ */
+inline bool numa_victim(unsigned int frame) {
+    return frame_table[frame].node == home_node(CURRENT_PID);
+}
+
+/// A process bound to its home node only evicts pages on that node
+inline bool victim_allowed(unsigned int frame) {
+    return NUMA_POLICY != 'b' || numa_victim(frame);
+}
+
+/**
+ * With several CPUs (`-m`) a PTE word is updated concurrently: the owning CPU
+ * sets R/M on hits while the pager, under the fault lock, reads R/M, clears R
+ * or unmaps the page. Every access to another process's PTE goes through
+ * atomics on the whole word, like the hardware A/D bit updates they model.
+ */
+inline unsigned int pte_mask(PTE pte) {
+    unsigned int word;
+    memcpy(&word, &pte, sizeof(word));
+    return word;
+}
+
+const unsigned int PTE_PRESENT = pte_mask([]{ PTE pte{}; pte.present = 1; return pte; }());
+const unsigned int PTE_REFERENCED = pte_mask([]{ PTE pte{}; pte.referenced = 1; return pte; }());
+const unsigned int PTE_MODIFIED = pte_mask([]{ PTE pte{}; pte.modified = 1; return pte; }());
+const unsigned int PTE_WRITE_PROTECT = pte_mask([]{ PTE pte{}; pte.write_protect = 1; return pte; }());
+const unsigned int PTE_PAGED_OUT = pte_mask([]{ PTE pte{}; pte.paged_out = 1; return pte; }());
+
+inline unsigned int* pte_word(PTE& pte) {
+    return reinterpret_cast<unsigned int*>(&pte);
+}
+
+inline void clear_referenced(PTE& pte) {
+    __atomic_fetch_and(pte_word(pte), ~PTE_REFERENCED, __ATOMIC_RELAXED);
+}
+
+inline void set_paged_out(PTE& pte) {
+    __atomic_fetch_or(pte_word(pte), PTE_PAGED_OUT, __ATOMIC_RELAXED);
+}
+
+/// Set the R and M bits that are set in `from`
+inline void merge_referenced_modified(PTE& pte, PTE from) {
+    __atomic_fetch_or(pte_word(pte), pte_mask(from) & (PTE_REFERENCED | PTE_MODIFIED),
+                      __ATOMIC_RELAXED);
+}
+
+inline PTE snapshot(PTE& pte) {
+    unsigned int word = __atomic_load_n(pte_word(pte), __ATOMIC_ACQUIRE);
+    PTE copy;
+    memcpy(&copy, &word, sizeof(copy));
+    return copy;
+}
+
+/**
+ * The entry that holds R/M for `vpage`: a huge page keeps them in the PTE of
+ * its first vpage
+ */
+inline PTE& page_entry(Process& process, unsigned int vpage) {
+    PTE& pte = process.page_table[vpage];
+    return snapshot(pte).huge ? process.page_table[vpage - vpage % HUGE_PAGES] : pte;
+}
+
+/// Clear the present bit, returning the PTE as it was at that moment
+inline PTE unmap(PTE& pte) {
+    unsigned int word = __atomic_fetch_and(pte_word(pte), ~PTE_PRESENT, __ATOMIC_ACQ_REL);
+    PTE old;
+    memcpy(&old, &word, sizeof(old));
+    return old;
+}
+
+/**
+ * Set R, and M for a permitted write, on a present page
+ *
+ * @param[out] was_referenced whether R was already set
+ * @return false if the page is not present
+ */
+inline bool touch(PTE& pte, bool write, bool& was_referenced) {
+    unsigned int word = __atomic_load_n(pte_word(pte), __ATOMIC_ACQUIRE);
+    unsigned int bits;
+    do {
+        if (!(word & PTE_PRESENT)) return false;
+        was_referenced = word & PTE_REFERENCED;
+        bits = PTE_REFERENCED;
+        if (write && !(word & PTE_WRITE_PROTECT)) bits |= PTE_MODIFIED;
+    } while (!__atomic_compare_exchange_n(pte_word(pte), &word, word | bits, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return true;
+}
+
+/**
+ * A frame shared by several processes counts as referenced (modified) if any
+ * of them referenced (modified) it
+ */
+inline bool frame_referenced(unsigned int frame) {
+    auto guard = lock_frame(frame);
+    if (snapshot(reversed_map(frame)).referenced) return true;
+    for (const Mapping& m : frame_table[frame].sharers) {
+        if (snapshot(process_pool[m.pid].page_table[m.vpage]).referenced) return true;
+    }
+    return false;
+}
+
+inline bool frame_modified(unsigned int frame) {
+    auto guard = lock_frame(frame);
+    if (snapshot(reversed_map(frame)).modified) return true;
+    for (const Mapping& m : frame_table[frame].sharers) {
+        if (snapshot(process_pool[m.pid].page_table[m.vpage]).modified) return true;
+    }
+    return false;
+}
+
+inline void clear_frame_referenced(unsigned int frame) {
+    auto guard = lock_frame(frame);
+    clear_referenced(reversed_map(frame));
+    for (const Mapping& m : frame_table[frame].sharers) {
+        clear_referenced(process_pool[m.pid].page_table[m.vpage]);
+    }
+}
+
+/// Identify a (pid, vpage) independently of the frame it lives in
+inline unsigned long page_key(unsigned int pid, unsigned int vpage) {
+    return static_cast<unsigned long>(pid) * MAX_VPAGE + vpage;
+}
+
+inline unsigned long page_key(unsigned int frame) {
+    return page_key(frame_table[frame].pid_rv, frame_table[frame].vpage_rv);
+}
+
 class Pager {
 protected:
     const bool OPTION_a;
@@ -103,17 +497,69 @@ public:
     Pager(bool OPTION_a) : OPTION_a(OPTION_a) {}
     virtual ~Pager() {}
     virtual void age_operation(unsigned int frame) {}
+    virtual void release_frame(unsigned int /*frame*/) {}
+    /// The page in `from` now lives in the free frame `to`
+    virtual void move_frame(unsigned int /*from*/, unsigned int /*to*/) {}
+    virtual void reference_operation(unsigned int /*frame*/) {}
+    /// The pool now has `frames` frames; frames past it were released first
+    virtual void resize(unsigned int /*frames*/) {}
     virtual unsigned int select_victim_frame() = 0;
 };
 
 class FifoPager : public Pager {
 protected:
     unsigned int hand;
+    bool home_first;    /// pass over remote frames while the home node has one
+    bool home_only;     /// the faulting process has a candidate on its home node
+    
+    bool candidate(unsigned int frame) {
+        return victim_allowed(frame) && (!home_only || numa_victim(frame));
+    }
+    
+    /// Tail frames of a huge page are never candidates on their own, and
+    /// frames a bound process left free on other nodes are not candidates
+    unsigned int next_frame(unsigned int frame) {
+        do {
+            frame = (frame+1) % NUM_FRAMES;
+        } while (frame_table[frame].tail || !frame_table[frame].mapped);
+        return frame;
+    }
+    
+    /// Next frame the faulting process may evict
+    unsigned int next_victim(unsigned int frame) {
+        do {
+            frame = next_frame(frame);
+        } while (!candidate(frame));
+        return frame;
+    }
+    
+    void skip_tail() {
+        hand = hand % NUM_FRAMES;
+        if (frame_table[hand].tail || !frame_table[hand].mapped) {
+            hand = next_frame(hand);
+        }
+    }
+    
+    void skip_to_victim() {
+        skip_tail();
+        home_only = false;
+        for (unsigned int f = 0; home_first && !home_only && f < NUM_FRAMES; f++) {
+            home_only = frame_table[f].mapped && !frame_table[f].tail
+                && victim_allowed(f) && numa_victim(f);
+        }
+        if (!candidate(hand)) {
+            hand = next_victim(hand);
+        }
+    }
 public:
-    FifoPager(bool OPTION_a) : Pager(OPTION_a), hand(0) {}
+    FifoPager(bool OPTION_a) : Pager(OPTION_a), hand(0), home_first(false), home_only(false) {}
+    
+    void resize(unsigned int frames) {
+        hand %= frames;
+    }
     
     virtual unsigned int select_victim_frame() {
-        hand = hand % NUM_FRAMES;
+        skip_to_victim();
         if (OPTION_a) {
             cout << "ASELECT " << hand << endl;
         }
@@ -126,14 +572,14 @@ public:
     ClockPager(bool OPTION_a) : FifoPager(OPTION_a) {}
     
     unsigned int select_victim_frame() {
+        skip_to_victim();
         unsigned int start = hand;
         unsigned int counter = 0;
         while (true) {
             counter++;
-            PTE& pte_rv = reversed_map(hand);
-            if (pte_rv.referenced) {
-                pte_rv.referenced = false;
-                hand = (hand+1) % NUM_FRAMES;
+            if (frame_referenced(hand)) {
+                clear_frame_referenced(hand);
+                hand = next_victim(hand);
             }
             else break;
         }
@@ -149,6 +595,19 @@ public:
     }
 };
 
+/**
+ * NUMA variant of a hand-based pager: its hand passes over candidates on nodes
+ * remote to the faulting process, leaving their R bits alone, unless the home
+ * node has no candidate at all
+ */
+template <typename Base>
+class HomeNodePager : public Base {
+public:
+    HomeNodePager(bool OPTION_a) : Base(OPTION_a) {
+        this->home_first = true;
+    }
+};
+
 class EscPager : public FifoPager {
 private:
     static const unsigned int RESET_CYCLE = 50;
@@ -157,20 +616,20 @@ public:
     EscPager(bool OPTION_a) : FifoPager(OPTION_a), last_reset(-1) {}
     
     unsigned int select_victim_frame() {
+        skip_to_victim();
         vector<int> classes(4, -1);
         unsigned int start = hand;
         unsigned int counter  = 0;
         bool reset = INSTR_COUNT-last_reset >= RESET_CYCLE;
         do {
             counter++;
-            PTE& pte_rv = reversed_map(hand);
-            int level = pte_rv.referenced*2 + pte_rv.modified;
+            int level = frame_referenced(hand)*2 + frame_modified(hand);
             if (classes[level] == -1) {
                 classes[level] = hand;
             }
             if (level == 0 && !reset) { break; }
-            if (reset) { pte_rv.referenced = false; }
-            hand = (hand+1) % NUM_FRAMES;
+            if (reset) { clear_frame_referenced(hand); }
+            hand = next_victim(hand);
         } while (hand != start);
         if (reset) { last_reset = INSTR_COUNT; }
         
@@ -191,118 +650,960 @@ public:
     }
 };
 
+/**
+ * Without `-oa` ages are kept lazily: a frame stores its age `age` as of epoch
+ * `stamp_` (one epoch per fault) and only frames referenced since the last
+ * fault are shifted. Since a referenced frame always has its top bit set at
+ * its stamp, ordering by (stamp, age) orders frames by current age, so the
+ * minimum is found in `ages_` instead of by a scan. `-oa` prints every frame
+ * and keeps the original scan.
+ */
 class AgingPager : public FifoPager {
-public:
-    AgingPager(bool OPTION_a) : FifoPager(OPTION_a) {}
+private:
+    static const unsigned int TOP = 0x80000000;
+    static const unsigned int WIDTH = 32;
     
-    void age_operation(unsigned int frame) {
-        frame_table[frame].age = 0;
+    unsigned long epoch_;                           /// faults so far
+    vector<unsigned long> stamp_;                   /// epoch of the stored age
+    vector<unsigned int> dirty_;                    /// referenced since last fault
+    vector<bool> is_dirty_;
+    vector<bool> tracked_;
+    map<pair<unsigned long, unsigned int>, set<unsigned int>> ages_;    /// (stamp, age) -> frames
+    set<unsigned int> idle_;                        /// frames whose age decayed to 0
+    
+    void track(unsigned int frame) {
+        tracked_[frame] = true;
+        unsigned int age = frame_table[frame].age;
+        if (age == 0 || epoch_ - stamp_[frame] >= WIDTH) {
+            idle_.insert(frame);
+        }
+        else {
+            ages_[make_pair(stamp_[frame], age)].insert(frame);
+        }
     }
     
-    unsigned int select_victim_frame() {
+    void untrack(unsigned int frame) {
+        if (!tracked_[frame]) return;
+        tracked_[frame] = false;
+        if (idle_.erase(frame)) return;
+        auto bucket = ages_.find(make_pair(stamp_[frame], frame_table[frame].age));
+        bucket->second.erase(frame);
+        if (bucket->second.empty()) {
+            ages_.erase(bucket);
+        }
+    }
+    
+    /**
+     * First frame of `frames` at or after `hand` that the faulting process
+     * may evict, wrapping around
+     *
+     * @return NUM_FRAMES if there is none
+     */
+    unsigned int first_from_hand(const set<unsigned int>& frames) {
+        auto it = frames.lower_bound(hand);
+        for (size_t i = 0; i < frames.size(); i++, ++it) {
+            if (it == frames.end()) it = frames.begin();
+            if (victim_allowed(*it)) return *it;
+        }
+        return NUM_FRAMES;
+    }
+    
+    unsigned int distance(unsigned int frame) {
+        return (frame + NUM_FRAMES - hand) % NUM_FRAMES;
+    }
+    
+    unsigned int select_lazy() {
+        epoch_++;
+        for (unsigned int frame : dirty_) {
+            if (!is_dirty_[frame]) continue;
+            is_dirty_[frame] = false;
+            untrack(frame);
+            unsigned long shift = epoch_ - stamp_[frame];
+            unsigned int& age = frame_table[frame].age;
+            age = (shift >= WIDTH ? 0 : age >> shift) | TOP;
+            stamp_[frame] = epoch_;
+            clear_frame_referenced(frame);
+            track(frame);
+        }
+        dirty_.clear();
+        
+        while (!ages_.empty() && epoch_ - ages_.begin()->first.first >= WIDTH) {
+            idle_.insert(ages_.begin()->second.begin(), ages_.begin()->second.end());
+            ages_.erase(ages_.begin());
+        }
+        
+        unsigned int victim = first_from_hand(idle_);
+        if (victim < NUM_FRAMES) {
+            return victim;
+        }
+        
+        auto youngest = ages_.begin();
+        while ((victim = first_from_hand(youngest->second)) == NUM_FRAMES) {
+            ++youngest;
+        }
+        // frames whose ages differ only in bits already shifted out are tied
+        unsigned long stamp = youngest->first.first;
+        unsigned long shift = epoch_ - stamp;
+        unsigned int current = youngest->first.second >> shift;
+        for (auto it = next(youngest); it != ages_.end(); ++it) {
+            if (it->first.first != stamp || (it->first.second >> shift) != current) break;
+            unsigned int frame = first_from_hand(it->second);
+            if (frame < NUM_FRAMES && distance(frame) < distance(victim)) {
+                victim = frame;
+            }
+        }
+        return victim;
+    }
+    
+    unsigned int select_scan() {
+        skip_tail();
         unsigned int start = hand;
-        unsigned int min = hand;
+        unsigned int min = NUM_FRAMES;
+        // every frame ages, only those the faulting process may evict compete
         do {
-            PTE& pte_rv = reversed_map(hand);
             frame_table[hand].age >>= 1;
-            if (pte_rv.referenced) {
-                frame_table[hand].age |= 0x80000000;
-                pte_rv.referenced = false;
+            if (frame_referenced(hand)) {
+                frame_table[hand].age |= TOP;
+                clear_frame_referenced(hand);
+            }
+            if (victim_allowed(hand)
+                && (min == NUM_FRAMES || frame_table[hand].age < frame_table[min].age)) {
+                min = hand;
             }
-            min = frame_table[hand].age<frame_table[min].age ? hand : min;
-            hand = (hand+1) % NUM_FRAMES;
+            hand = next_frame(hand);
         } while (hand != start);
         
+        cout << "ASELECT " << start
+             << "-" << (hand-1) % NUM_FRAMES << " | ";
+        do {
+            cout << start << ":"
+                 << hex << frame_table[start].age << dec << " ";
+            start = next_frame(start);
+        } while (start != hand);
+        cout << "| " << min << endl;
+        return min;
+    }
+public:
+    AgingPager(bool OPTION_a) :
+    FifoPager(OPTION_a),
+    epoch_(0),
+    stamp_(NUM_FRAMES, 0),
+    is_dirty_(NUM_FRAMES, false),
+    tracked_(NUM_FRAMES, false) {}
+    
+    void age_operation(unsigned int frame) {
         if (OPTION_a) {
-            cout << "ASELECT " << start
-                 << "-" << (hand-1) % NUM_FRAMES << " | ";
-            do {
-                cout << start << ":"
-                     << hex << frame_table[start].age << dec << " ";
-                start = (start+1) % NUM_FRAMES;
-            } while (start != hand);
-            cout << "| " << min << endl;
+            frame_table[frame].age = 0;
+            return;
         }
-        
-        hand = (min+1) % NUM_FRAMES;
-        return min;
+        untrack(frame);
+        frame_table[frame].age = 0;
+        stamp_[frame] = epoch_;
+        track(frame);
+        reference_operation(frame);
+    }
+    
+    void reference_operation(unsigned int frame) {
+        if (!OPTION_a && !is_dirty_[frame]) {
+            is_dirty_[frame] = true;
+            dirty_.push_back(frame);
+        }
+    }
+    
+    void release_frame(unsigned int frame) {
+        if (!OPTION_a) {
+            untrack(frame);
+            is_dirty_[frame] = false;
+        }
+    }
+    
+    /// The age moves with the frame table entry; its bookkeeping follows
+    void move_frame(unsigned int from, unsigned int to) {
+        if (OPTION_a) return;
+        stamp_[to] = stamp_[from];
+        if (tracked_[from]) {
+            untrack(from);
+            track(to);
+        }
+        if (is_dirty_[from]) {
+            is_dirty_[from] = false;
+            is_dirty_[to] = true;
+            dirty_.push_back(to);
+        }
+    }
+    
+    void resize(unsigned int frames) {
+        FifoPager::resize(frames);
+        dirty_.erase(remove_if(dirty_.begin(), dirty_.end(), [=](unsigned int frame) {
+            return frame >= frames;
+        }), dirty_.end());
+        stamp_.resize(frames, 0);
+        is_dirty_.resize(frames, false);
+        tracked_.resize(frames, false);
+    }
+    
+    unsigned int select_victim_frame() {
+        unsigned int victim = OPTION_a ? select_scan() : select_lazy();
+        hand = (victim+1) % NUM_FRAMES;
+        return victim;
     }
 };
 
+/**
+ * Without `-oa` the hand does not visit every frame: `dirty_` holds the
+ * referenced frames, `expired_` the frames idle for more than TAU and
+ * `by_time_` the others bucketed by `last_used`. Only referenced frames the
+ * hand passes are updated, exactly as the scan would. `-oa` keeps the scan.
+ */
 class WorkingSetPager : public FifoPager {
 private:
     static const unsigned int TAU = 49;
     vector<unsigned long> last_used;
-public:
-    WorkingSetPager(bool OPTION_a) : FifoPager(OPTION_a), last_used(NUM_FRAMES) {}
+    set<unsigned int> dirty_;
+    set<unsigned int> expired_;
+    map<unsigned long, set<unsigned int>> by_time_;
     
-    void age_operation(unsigned int frame) {
+    void untrack(unsigned int frame) {
+        if (expired_.erase(frame)) return;
+        auto bucket = by_time_.find(last_used[frame]);
+        if (bucket != by_time_.end()) {
+            bucket->second.erase(frame);
+            if (bucket->second.empty()) {
+                by_time_.erase(bucket);
+            }
+        }
+    }
+    
+    void touch(unsigned int frame) {
+        untrack(frame);
         last_used[frame] = INSTR_COUNT;
+        by_time_[INSTR_COUNT].insert(frame);
     }
     
-    unsigned int select_victim_frame() {
+    /// Clear the reference bits the hand passes in [first, last)
+    void sweep(unsigned int first, unsigned int last) {
+        auto it = dirty_.lower_bound(first);
+        while (it != dirty_.end() && *it < last) {
+            touch(*it);
+            clear_frame_referenced(*it);
+            it = dirty_.erase(it);
+        }
+    }
+    
+    unsigned int select_lazy() {
+        while (!by_time_.empty() && INSTR_COUNT-by_time_.begin()->first > TAU) {
+            expired_.insert(by_time_.begin()->second.begin(), by_time_.begin()->second.end());
+            by_time_.erase(by_time_.begin());
+        }
+        
+        // first idle frame after the hand that was not referenced meanwhile
+        auto it = expired_.lower_bound(hand);
+        for (size_t i = 0; i < expired_.size(); i++, ++it) {
+            if (it == expired_.end()) it = expired_.begin();
+            if (dirty_.count(*it) || !victim_allowed(*it)) continue;
+            unsigned int victim = *it;
+            if (victim >= hand) {
+                sweep(hand, victim);
+            }
+            else {
+                sweep(hand, NUM_FRAMES);
+                sweep(0, victim);
+            }
+            return victim;
+        }
+        
+        // full circle: every referenced frame was refreshed, take the oldest
+        sweep(0, NUM_FRAMES);
+        for (const auto& bucket : by_time_) {
+            const set<unsigned int>& oldest = bucket.second;
+            auto victim = oldest.lower_bound(hand);
+            for (size_t i = 0; i < oldest.size(); i++, ++victim) {
+                if (victim == oldest.end()) victim = oldest.begin();
+                if (victim_allowed(*victim)) return *victim;
+            }
+        }
+        return hand;
+    }
+    
+    unsigned int select_scan() {
+        skip_tail();
         unsigned int start = hand;
-        unsigned int oldest = hand;
+        unsigned int oldest = NUM_FRAMES;
         stringstream ss;
         do {
-            PTE& pte_rv = reversed_map(hand);
-            if (OPTION_a) {
-                ss << hand << "(" << pte_rv.referenced
-                   << " " << frame_table[hand].pid_rv
-                   << ":" << frame_table[hand].vpage_rv
-                   << " " << last_used[hand] << ") ";
-            }
-            if (pte_rv.referenced) {
+            bool referenced = frame_referenced(hand);
+            ss << hand << "(" << referenced
+               << " " << frame_table[hand].pid_rv
+               << ":" << frame_table[hand].vpage_rv
+               << " " << last_used[hand] << ") ";
+            if (referenced) {
                 last_used[hand] = INSTR_COUNT;
-                pte_rv.referenced = false;
+                clear_frame_referenced(hand);
             }
-            else if (INSTR_COUNT-last_used[hand] > TAU) {
-                if (OPTION_a) {
-                    ss << "STOP(" << (hand < start ?
-                                      hand-start+NUM_FRAMES+1 :
-                                      hand-start+1)  << ") ";
-                }
+            else if (victim_allowed(hand) && INSTR_COUNT-last_used[hand] > TAU) {
+                ss << "STOP(" << (hand < start ?
+                                  hand-start+NUM_FRAMES+1 :
+                                  hand-start+1)  << ") ";
                 oldest = hand;
                 break;
             }
-            oldest = last_used[hand]<last_used[oldest] ? hand : oldest;
-            hand = (hand+1) % NUM_FRAMES;
+            if (victim_allowed(hand)
+                && (oldest == NUM_FRAMES || last_used[hand] < last_used[oldest])) {
+                oldest = hand;
+            }
+            hand = next_frame(hand);
         } while (hand != start);
         
-        if (OPTION_a) {
-            cout << "ASELECT " << start
-                 << "-" << (start-1) % NUM_FRAMES << " | "
-                 << ss.str() << "| " << oldest << endl;
-        }
-        
-        hand = (oldest+1) % NUM_FRAMES;
+        cout << "ASELECT " << start
+             << "-" << (start-1) % NUM_FRAMES << " | "
+             << ss.str() << "| " << oldest << endl;
         return oldest;
     }
-};
-
-class RFile {
-private:
-    vector<int> randvals;   /// Store the  values from rfile
-    size_t ofs;             /// Current offset in `randvals`
 public:
-    RFile(const string path) : ofs(0) {
-        ifstream ifs(path);
-        int n;
-        ifs >> n;
-        while(ifs >> n) {
-            randvals.push_back(n);
+    WorkingSetPager(bool OPTION_a) : FifoPager(OPTION_a), last_used(NUM_FRAMES) {}
+    
+    void age_operation(unsigned int frame) {
+        if (OPTION_a) {
+            last_used[frame] = INSTR_COUNT;
+            return;
         }
+        touch(frame);
+        dirty_.insert(frame);
     }
     
-    /**
-     * Get a random integer [0, `bound`-1] inclusive using values `randvals` at location `ofs`
-     *
-     * @param[in] bound the upper bound of the random integer
-     * @return a random integer
-     */
-    unsigned int randInt(const unsigned int bound) {
-        ofs = ofs % randvals.size();
-        return randvals[ofs++] % bound;
+    void reference_operation(unsigned int frame) {
+        if (!OPTION_a) {
+            dirty_.insert(frame);
+        }
+    }
+    
+    void release_frame(unsigned int frame) {
+        if (!OPTION_a) {
+            untrack(frame);
+            dirty_.erase(frame);
+        }
+    }
+    
+    void move_frame(unsigned int from, unsigned int to) {
+        last_used[to] = last_used[from];
+        if (OPTION_a) return;
+        if (expired_.erase(from)) {
+            expired_.insert(to);
+        }
+        else {
+            untrack(from);
+            by_time_[last_used[to]].insert(to);
+        }
+        if (dirty_.erase(from)) {
+            dirty_.insert(to);
+        }
+    }
+    
+    void resize(unsigned int frames) {
+        FifoPager::resize(frames);
+        last_used.resize(frames, 0);
+    }
+    
+    unsigned int select_victim_frame() {
+        unsigned int victim = OPTION_a ? select_scan() : select_lazy();
+        hand = (victim+1) % NUM_FRAMES;
+        return victim;
+    }
+};
+
+/**
+ * ARC in its CAR form (Bansal & Modha): the simulator only exposes reference
+ * bits, so T1/T2 are clocks instead of LRU lists. B1/B2 remember the pages
+ * recently evicted from T1/T2 and steer the target size `p_` of T1.
+ */
+class ArcPager : public Pager {
+private:
+    enum LIST { NONE, T1, T2 };
+    
+    unsigned int p_;                                /// target size of T1
+    list<unsigned int> t1_, t2_;                    /// resident frames, front = hand
+    list<unsigned long> b1_, b2_;                   /// ghost pages, front = LRU
+    vector<LIST> where_;                            /// clock holding each frame
+    vector<list<unsigned int>::iterator> pos_;      /// frame position in its clock
+    unordered_map<unsigned long, pair<LIST, list<unsigned long>::iterator>> ghosts_;
+    bool replaced_;                                 /// the current miss ran `replace`
+    
+    void forget(list<unsigned long>& ghost) {
+        ghosts_.erase(ghost.front());
+        ghost.pop_front();
+    }
+    
+    void remember(list<unsigned long>& ghost, LIST which, unsigned long key) {
+        ghost.push_back(key);
+        ghosts_[key] = make_pair(which, prev(ghost.end()));
+    }
+    
+    void append(list<unsigned int>& clock, LIST which, unsigned int frame) {
+        clock.push_back(frame);
+        where_[frame] = which;
+        pos_[frame] = prev(clock.end());
+    }
+    
+    static bool has_victim(const list<unsigned int>& clock) {
+        return any_of(clock.begin(), clock.end(), victim_allowed);
+    }
+public:
+    ArcPager(bool OPTION_a) :
+    Pager(OPTION_a),
+    p_(0),
+    where_(NUM_FRAMES, NONE),
+    pos_(NUM_FRAMES),
+    replaced_(false) {}
+    
+    void age_operation(unsigned int frame) {
+        // a newly cached page has not proven any reuse yet
+        clear_frame_referenced(frame);
+        unsigned long key = page_key(frame);
+        auto ghost = ghosts_.find(key);
+        
+        // frames freed by exits refill without `replace`, so the directory
+        // can briefly outgrow c/2c; trim it back on the next full miss
+        if (replaced_ && ghost == ghosts_.end()) {
+            if (t1_.size() + b1_.size() >= NUM_FRAMES && !b1_.empty()) {
+                forget(b1_);
+            }
+            else if (t1_.size() + t2_.size() + b1_.size() + b2_.size() >= 2*NUM_FRAMES
+                     && !b2_.empty()) {
+                forget(b2_);
+            }
+        }
+        replaced_ = false;
+        
+        if (ghost == ghosts_.end()) {
+            append(t1_, T1, frame);
+            return;
+        }
+        
+        unsigned int b1 = static_cast<unsigned int>(b1_.size());
+        unsigned int b2 = static_cast<unsigned int>(b2_.size());
+        if (ghost->second.first == T1) {
+            p_ = min(p_ + max(1u, b2/b1), NUM_FRAMES);
+            b1_.erase(ghost->second.second);
+        }
+        else {
+            unsigned int delta = max(1u, b1/b2);
+            p_ = p_ > delta ? p_-delta : 0;
+            b2_.erase(ghost->second.second);
+        }
+        ghosts_.erase(ghost);
+        append(t2_, T2, frame);
+    }
+    
+    void release_frame(unsigned int frame) {
+        if (where_[frame] != NONE) {
+            (where_[frame] == T1 ? t1_ : t2_).erase(pos_[frame]);
+            where_[frame] = NONE;
+        }
+    }
+    
+    void move_frame(unsigned int from, unsigned int to) {
+        if (where_[from] != NONE) {
+            *pos_[from] = to;
+            where_[to] = where_[from];
+            pos_[to] = pos_[from];
+            where_[from] = NONE;
+        }
+    }
+    
+    /// A smaller cache also remembers fewer evicted pages
+    void resize(unsigned int frames) {
+        where_.resize(frames, NONE);
+        pos_.resize(frames);
+        p_ = min(p_, frames);
+        while (t1_.size() + b1_.size() > frames && !b1_.empty()) {
+            forget(b1_);
+        }
+        while (t1_.size() + t2_.size() + b1_.size() + b2_.size() > 2*frames && !b2_.empty()) {
+            forget(b2_);
+        }
+    }
+    
+    unsigned int select_victim_frame() {
+        unsigned int victim;
+        unsigned int counter = 0;
+        replaced_ = true;
+        while (true) {
+            counter++;
+            // huge pages leave T1+T2 short of c, so T2 may be empty here
+            bool from_t1 = t2_.empty() || t1_.size() >= max(1u, p_);
+            if (NUMA_POLICY == 'b' && !has_victim(from_t1 ? t1_ : t2_)) {
+                from_t1 = !from_t1;
+            }
+            list<unsigned int>& clock = from_t1 ? t1_ : t2_;
+            victim = clock.front();
+            if (!victim_allowed(victim)) {
+                // pages on other nodes keep their bits for their own processes
+                clock.splice(clock.end(), clock, clock.begin());
+                continue;
+            }
+            if (!frame_referenced(victim)) {
+                clock.pop_front();
+                where_[victim] = NONE;
+                if (from_t1) remember(b1_, T1, page_key(victim));
+                else remember(b2_, T2, page_key(victim));
+                break;
+            }
+            // referenced pages graduate to (or stay in) the frequency clock
+            clear_frame_referenced(victim);
+            t2_.splice(t2_.end(), clock, clock.begin());
+            where_[victim] = T2;
+        }
+        
+        if (OPTION_a) {
+            cout << "ASELECT " << victim << " " << counter
+                 << " | p=" << p_
+                 << " T1=" << t1_.size() << " T2=" << t2_.size()
+                 << " B1=" << b1_.size() << " B2=" << b2_.size() << endl;
+        }
+        return victim;
+    }
+};
+
+/**
+ * CLOCK-Pro (Jiang, Chen & Zhang): one clock of hot pages, resident cold pages
+ * and non-resident cold pages still in their test period. HAND_cold picks
+ * victims, HAND_hot demotes hot pages and HAND_test ends test periods. The
+ * cold target `cold_target_` grows when a page re-faults during its test period
+ * and shrinks when a test period expires.
+ */
+class ClockProPager : public Pager {
+private:
+    struct Page {
+        unsigned long key;
+        int frame;          /// -1 while non-resident
+        unsigned int size;  /// frames held, more than one for a huge page
+        bool hot;
+        bool test;
+    };
+    typedef list<Page>::iterator Hand;
+    
+    list<Page> clock_;
+    Hand hand_hot_, hand_cold_, hand_test_;
+    vector<Hand> resident_;                     /// frame -> page, `clock_.end()` if none
+    unordered_map<unsigned long, Hand> nonresident_;
+    unsigned int cold_target_;
+    unsigned int hot_count_;                    /// in frames, like the targets
+    
+    void advance(Hand& hand) {
+        if (++hand == clock_.end()) hand = clock_.begin();
+    }
+    
+    void erase(Hand it) {
+        for (Hand* hand : {&hand_hot_, &hand_cold_, &hand_test_}) {
+            if (*hand == it) advance(*hand);
+        }
+        clock_.erase(it);
+        if (clock_.empty()) {
+            hand_hot_ = hand_cold_ = hand_test_ = clock_.end();
+        }
+    }
+    
+    /// The list head is just behind HAND_hot, the last place any hand reaches
+    Hand insert_head(const Page& page) {
+        if (clock_.empty()) {
+            clock_.push_back(page);
+            hand_hot_ = hand_cold_ = hand_test_ = clock_.begin();
+            return clock_.begin();
+        }
+        return clock_.insert(hand_hot_, page);
+    }
+    
+    void move_head(Hand it) {
+        for (Hand* hand : {&hand_hot_, &hand_cold_, &hand_test_}) {
+            if (*hand == it) advance(*hand);
+        }
+        clock_.splice(hand_hot_, clock_, it);
+    }
+    
+    void end_test(Hand it) {
+        nonresident_.erase(it->key);
+        erase(it);
+        cold_target_ = max(1u, cold_target_-1);
+    }
+    
+    void demote(Hand it) {
+        it->hot = false;
+        it->test = false;
+        hot_count_ -= it->size;
+    }
+    
+    void run_hand_hot() {
+        while (true) {
+            Hand it = hand_hot_;
+            advance(hand_hot_);
+            if (it->hot) {
+                if (!frame_referenced(it->frame)) {
+                    demote(it);
+                    return;
+                }
+                clear_frame_referenced(it->frame);
+            }
+            else if (it->frame < 0) {
+                end_test(it);
+            }
+            else {
+                it->test = false;
+            }
+        }
+    }
+    
+    void run_hand_test() {
+        while (true) {
+            Hand it = hand_test_;
+            advance(hand_test_);
+            if (!it->hot && it->frame < 0) {
+                end_test(it);
+                return;
+            }
+            it->test &= it->hot;
+        }
+    }
+    
+    void balance() {
+        while (hot_count_ > NUM_FRAMES - cold_target_) {
+            run_hand_hot();
+        }
+    }
+public:
+    ClockProPager(bool OPTION_a) :
+    Pager(OPTION_a),
+    hand_hot_(clock_.end()),
+    hand_cold_(clock_.end()),
+    hand_test_(clock_.end()),
+    resident_(NUM_FRAMES, clock_.end()),
+    cold_target_(1),
+    hot_count_(0) {}
+    
+    void age_operation(unsigned int frame) {
+        unsigned int size = snapshot(reversed_map(frame)).huge ? HUGE_PAGES : 1;
+        clear_frame_referenced(frame);
+        unsigned long key = page_key(frame);
+        auto ghost = nonresident_.find(key);
+        bool hot = hot_count_ + size <= NUM_FRAMES - cold_target_;
+        if (ghost != nonresident_.end()) {
+            // re-faulted within its test period: cold pages deserve more room
+            erase(ghost->second);
+            nonresident_.erase(ghost);
+            cold_target_ = min(cold_target_+1, max(1u, NUM_FRAMES-1));
+            hot = true;
+        }
+        resident_[frame] = insert_head(Page{key, static_cast<int>(frame), size, hot, !hot});
+        hot_count_ += hot ? size : 0;
+        balance();
+    }
+    
+    void release_frame(unsigned int frame) {
+        if (resident_[frame] != clock_.end()) {
+            hot_count_ -= resident_[frame]->hot ? resident_[frame]->size : 0;
+            erase(resident_[frame]);
+            resident_[frame] = clock_.end();
+        }
+    }
+    
+    void move_frame(unsigned int from, unsigned int to) {
+        resident_[to] = resident_[from];
+        resident_[from] = clock_.end();
+        if (resident_[to] != clock_.end()) {
+            resident_[to]->frame = static_cast<int>(to);
+        }
+    }
+    
+    void resize(unsigned int frames) {
+        resident_.resize(frames, clock_.end());
+        cold_target_ = min(cold_target_, max(1u, frames-1));
+        balance();
+        while (nonresident_.size() > frames) {
+            run_hand_test();
+        }
+    }
+    
+    unsigned int select_victim_frame() {
+        unsigned int counter = 0;
+        size_t skipped = 0;
+        bool anywhere = false;      /// a bound process with no page of its own
+        Hand local = clock_.end();  /// first hot page of this round it may evict
+        while (true) {
+            counter++;
+            Hand it = hand_cold_;
+            bool allowed = it->frame >= 0 && (anywhere || victim_allowed(it->frame));
+            if (it->hot || !allowed) {
+                if (it->hot && allowed && local == clock_.end()) {
+                    local = it;
+                }
+                advance(hand_cold_);
+                // a full round without a cold page to evict: HAND_hot demotes
+                // one, but for a bound process it must be one of its own, and
+                // with none of those it evicts wherever the hand finds a page
+                if (++skipped > clock_.size()) {
+                    if (NUMA_POLICY != 'b') {
+                        run_hand_hot();
+                    }
+                    else if (local != clock_.end()) {
+                        demote(local);
+                    }
+                    else {
+                        anywhere = true;
+                    }
+                    skipped = 0;
+                    local = clock_.end();
+                }
+                continue;
+            }
+            skipped = 0;
+            if (frame_referenced(it->frame)) {
+                clear_frame_referenced(it->frame);
+                if (it->test) {
+                    it->hot = true;
+                    it->test = false;
+                    hot_count_ += it->size;
+                }
+                else {
+                    it->test = true;
+                }
+                move_head(it);
+                balance();
+                continue;
+            }
+            
+            unsigned int victim = it->frame;
+            resident_[victim] = clock_.end();
+            advance(hand_cold_);
+            if (it->test) {
+                it->frame = -1;
+                nonresident_[it->key] = it;
+                while (nonresident_.size() > NUM_FRAMES) {
+                    run_hand_test();
+                }
+            }
+            else {
+                erase(it);
+            }
+            
+            if (OPTION_a) {
+                cout << "ASELECT " << victim << " " << counter
+                     << " | hot=" << hot_count_
+                     << " m_c=" << cold_target_
+                     << " test=" << nonresident_.size() << endl;
+            }
+            return victim;
+        }
+    }
+};
+
+/**
+ * Belady's OPT on a fully buffered trace: evict the frame whose next use is
+ * farthest away, counting every process sharing it and every base page of a
+ * huge page. Hits are not reported to the pager, so the accesses since the
+ * last fault are replayed lazily to refresh the heap.
+ */
+class OptPager : public Pager {
+private:
+    static const unsigned long NEVER = ULONG_MAX;
+    
+    struct Candidate {
+        unsigned long next_use;
+        unsigned int frame;
+        unsigned long generation;
+        
+        bool operator < (const Candidate& other) const {
+            return next_use < other.next_use
+                || (next_use == other.next_use && frame > other.frame);
+        }
+    };
+    
+    const vector<Instruction>& trace_;
+    vector<unsigned long> next_use_;        /// instruction -> next access to its page
+    vector<unsigned int> pid_;              /// instruction -> running process
+    unordered_map<unsigned long, unsigned long> upcoming_;  /// page -> next access from `scanned_` on
+    vector<unsigned long> frame_next_;      /// frame -> next use of any page in it
+    vector<bool> shared_;                   /// frame had sharers when last pushed
+    vector<unsigned long> generation_;      /// bumped whenever a frame is unmapped
+    priority_queue<Candidate> heap_;        /// stale entries are skipped lazily
+    unsigned long scanned_;                 /// accesses before this are in the heap
+    
+    void push(unsigned int frame, unsigned long next_use) {
+        frame_next_[frame] = next_use;
+        heap_.push(Candidate{next_use, frame, generation_[frame]});
+    }
+    
+    unsigned long upcoming(unsigned int pid, unsigned int vpage) const {
+        auto it = upcoming_.find(page_key(pid, vpage));
+        return it == upcoming_.end() ? NEVER : it->second;
+    }
+    
+    /// Next use of a page mapped by (`pid`, `vpage`), over all of a huge page
+    unsigned long upcoming_span(unsigned int pid, unsigned int vpage) const {
+        if (!process_pool[pid].page_table[vpage].huge) {
+            return upcoming(pid, vpage);
+        }
+        unsigned long next = NEVER;
+        unsigned int head = vpage - vpage % HUGE_PAGES;
+        for (unsigned int i = 0; i < HUGE_PAGES; i++) {
+            next = min(next, upcoming(pid, head+i));
+        }
+        return next;
+    }
+    
+    unsigned long frame_next_use(unsigned int frame) {
+        const Frame& entry = frame_table[frame];
+        unsigned long next = upcoming_span(entry.pid_rv, entry.vpage_rv);
+        for (const Mapping& m : entry.sharers) {
+            next = min(next, upcoming_span(m.pid, m.vpage));
+        }
+        shared_[frame] = !entry.sharers.empty();
+        return next;
+    }
+    
+    void catch_up() {
+        for (; scanned_ < INSTR_COUNT; scanned_++) {
+            char operation = trace_[scanned_].operation;
+            if (operation != 'r' && operation != 'w') continue;
+            upcoming_[page_key(pid_[scanned_], trace_[scanned_].operand)] = next_use_[scanned_];
+            PTE& pte = page_entry(process_pool[pid_[scanned_]], trace_[scanned_].operand);
+            if (pte.present) {
+                push(pte.frame, frame_next_use(pte.frame));
+            }
+        }
+        // forks, shared maps and copy-on-write change who uses a frame
+        // without an access to it being replayed
+        for (unsigned int f = 0; SHARING && f < NUM_FRAMES; f++) {
+            if (frame_table[f].mapped && (shared_[f] || !frame_table[f].sharers.empty())) {
+                unsigned long next = frame_next_use(f);
+                if (next != frame_next_[f]) {
+                    push(f, next);
+                }
+            }
+        }
+        // rebuild once stale entries dominate
+        if (heap_.size() > 4 * NUM_FRAMES) {
+            priority_queue<Candidate> heap;
+            for (unsigned int f = 0; f < NUM_FRAMES; f++) {
+                if (frame_table[f].mapped) {
+                    heap.push(Candidate{frame_next_[f], f, generation_[f]});
+                }
+            }
+            heap_.swap(heap);
+        }
+    }
+public:
+    OptPager(bool OPTION_a, const vector<Instruction>& trace) :
+    Pager(OPTION_a),
+    trace_(trace),
+    next_use_(trace.size(), NEVER),
+    pid_(trace.size(), 0),
+    frame_next_(NUM_FRAMES, NEVER),
+    shared_(NUM_FRAMES, false),
+    generation_(NUM_FRAMES, 0),
+    scanned_(0) {
+        unsigned int pid = CURRENT_PID;
+        for (size_t i = 0; i < trace.size(); i++) {
+            if (trace[i].operation == 'c') {
+                pid = trace[i].operand;
+            }
+            pid_[i] = pid;
+        }
+        unordered_map<unsigned long, unsigned long> seen;
+        for (size_t i = trace.size(); i-- > 0;) {
+            if (trace[i].operation != 'r' && trace[i].operation != 'w') continue;
+            unsigned long key = page_key(pid_[i], trace[i].operand);
+            auto it = seen.find(key);
+            if (it != seen.end()) {
+                next_use_[i] = it->second;
+            }
+            seen[key] = i;
+        }
+        upcoming_.swap(seen);
+    }
+    
+    void age_operation(unsigned int frame) {
+        catch_up();
+        upcoming_[page_key(pid_[INSTR_COUNT], trace_[INSTR_COUNT].operand)] = next_use_[INSTR_COUNT];
+        push(frame, frame_next_use(frame));
+    }
+    
+    void release_frame(unsigned int frame) {
+        generation_[frame]++;
+    }
+    
+    void move_frame(unsigned int from, unsigned int to) {
+        generation_[from]++;
+        shared_[to] = shared_[from];
+        push(to, frame_next_[from]);
+    }
+    
+    /// Entries of frames that left the pool must not outlive them
+    void resize(unsigned int frames) {
+        frame_next_.resize(frames, NEVER);
+        shared_.resize(frames, false);
+        generation_.resize(frames, 0);
+        priority_queue<Candidate> heap;
+        for (unsigned int f = 0; f < frames; f++) {
+            if (frame_table[f].mapped) {
+                heap.push(Candidate{frame_next_[f], f, generation_[f]});
+            }
+        }
+        heap_.swap(heap);
+    }
+    
+    unsigned int select_victim_frame() {
+        catch_up();
+        vector<Candidate> remote;
+        while (heap_.top().generation != generation_[heap_.top().frame]
+               || heap_.top().next_use != frame_next_[heap_.top().frame]
+               || !victim_allowed(heap_.top().frame)) {
+            if (heap_.top().generation == generation_[heap_.top().frame]
+                && heap_.top().next_use == frame_next_[heap_.top().frame]) {
+                remote.push_back(heap_.top());
+            }
+            heap_.pop();
+        }
+        Candidate victim = heap_.top();
+        heap_.pop();
+        generation_[victim.frame]++;
+        for (const Candidate& candidate : remote) {
+            heap_.push(candidate);
+        }
+        
+        if (OPTION_a) {
+            cout << "ASELECT " << victim.frame << " | next=";
+            if (victim.next_use == NEVER) cout << "-";
+            else cout << victim.next_use;
+            cout << endl;
+        }
+        return victim.frame;
+    }
+};
+
+const unsigned long OptPager::NEVER;
+
+class RFile {
+private:
+    vector<int> randvals;   /// Store the  values from rfile
+    size_t ofs;             /// Current offset in `randvals`
+public:
+    RFile(const string path) : ofs(0) {
+        ifstream ifs(path);
+        int n;
+        ifs >> n;
+        while(ifs >> n) {
+            randvals.push_back(n);
+        }
+    }
+    
+    /**
+     * Get a random integer [0, `bound`-1] inclusive using values `randvals` at location `ofs`
+     *
+     * @param[in] bound the upper bound of the random integer
+     * @return a random integer
+     */
+    unsigned int randInt(const unsigned int bound) {
+        ofs = ofs % randvals.size();
+        return randvals[ofs++] % bound;
     }
 };
 
@@ -313,7 +1614,307 @@ public:
     RandomPager(bool OPTION_a, string rfile) : Pager(OPTION_a), rfile(rfile) {}
     
     unsigned int select_victim_frame() {
-        return rfile.randInt(NUM_FRAMES);
+        unsigned int victim;
+        do {
+            victim = rfile.randInt(NUM_FRAMES);
+        } while (!frame_table[victim].mapped || !victim_allowed(victim));
+        return victim;
+    }
+};
+
+class TLB {
+private:
+    struct Entry {
+        unsigned int valid:1;
+        unsigned int asid:16;     /// as wide as `Frame::pid_rv`
+        unsigned int vpage:6;
+        unsigned long last_used;
+    };
+    
+    const unsigned int sets_;
+    const unsigned int ways_;
+    const bool asid_tagged_;    /// keep entries across `c` instead of flushing
+    const bool lru_;            /// LRU replacement, otherwise random
+    vector<Entry> entries_;     /// `sets_` x `ways_`, row-major
+    RFile rfile_;
+    unsigned long clock_;
+    
+    Entry* find(unsigned int pid, unsigned int vpage) {
+        Entry* set = &entries_[(vpage % sets_) * ways_];
+        for (unsigned int i = 0; i < ways_; i++) {
+            if (set[i].valid && set[i].asid == pid && set[i].vpage == vpage) {
+                return &set[i];
+            }
+        }
+        return nullptr;
+    }
+public:
+    TLB(unsigned int entries, unsigned int ways, bool asid_tagged, bool lru, string rfile) :
+    sets_(entries / ways),
+    ways_(ways),
+    asid_tagged_(asid_tagged),
+    lru_(lru),
+    entries_(entries / ways * ways, Entry()),
+    rfile_(rfile),
+    clock_(0) {}
+    
+    /**
+     * Look up the translation of `vpage` for process `pid`
+     *
+     * @return true on a TLB hit
+     */
+    bool lookup(unsigned int pid, unsigned int vpage) {
+        Entry* entry = find(pid, vpage);
+        if (entry) {
+            entry->last_used = ++clock_;
+        }
+        return entry != nullptr;
+    }
+    
+    /**
+     * Cache the translation after a page walk, replacing an invalid entry
+     * first, then the LRU or a random way of the set
+     */
+    void insert(unsigned int pid, unsigned int vpage) {
+        Entry* set = &entries_[(vpage % sets_) * ways_];
+        Entry* victim = nullptr;
+        for (unsigned int i = 0; i < ways_ && !victim; i++) {
+            if (!set[i].valid) victim = &set[i];
+        }
+        if (!victim && lru_) {
+            victim = set;
+            for (unsigned int i = 1; i < ways_; i++) {
+                victim = set[i].last_used < victim->last_used ? &set[i] : victim;
+            }
+        }
+        else if (!victim) {
+            victim = &set[rfile_.randInt(ways_)];
+        }
+        victim->valid = true;
+        victim->asid = pid;
+        victim->vpage = vpage;
+        victim->last_used = ++clock_;
+    }
+    
+    /**
+     * Drop the translation of an unmapped page
+     *
+     * @return whether the translation was cached
+     */
+    bool invalidate(unsigned int pid, unsigned int vpage) {
+        Entry* entry = find(pid, vpage);
+        if (entry) {
+            entry->valid = false;
+        }
+        return entry != nullptr;
+    }
+    
+    /// Drop every translation of `pid`, e.g. on process exit
+    void invalidate(unsigned int pid) {
+        for (Entry& entry : entries_) {
+            entry.valid &= entry.asid != pid;
+        }
+    }
+    
+    /// Context switch: untagged TLBs lose all their translations
+    void context_switch() {
+        if (!asid_tagged_) {
+            for (Entry& entry : entries_) {
+                entry.valid = false;
+            }
+        }
+    }
+};
+
+/**
+ * Swap device of `-s`. Requests are served one at a time in arrival order,
+ * a read taking `INS` and a write `OUTS` cycles, with `COST` as the clock: a
+ * fault waits for the requests queued ahead of its own as well.
+ *
+ * While no frame is free and the device is idle, the oldest frame on the
+ * dirty list is written back in the background, so a later eviction finds it
+ * clean. A demand read also reads up to `window` paged-out vpages following
+ * it into the device buffer at `READ_AHEAD` cycles each; a fault on one of
+ * them only waits for the rest of that transfer.
+ *
+ * Every fault-path request is also charged what the flat synchronous model
+ * would have cost, so the report shows the latency saved.
+ */
+class SwapDevice {
+private:
+    const unsigned int window_;
+    const bool writeback_;                  /// clean frames in the background
+    unsigned long long busy_until_;
+    deque<unsigned int> dirty_;             /// frames in the order they were dirtied
+    map<unsigned long, unsigned long long> buffer_; /// read-ahead page -> ready time
+    
+    /// Queue a request of `service` cycles at `now`, returning its completion
+    unsigned long long submit(unsigned long long now, unsigned long long service) {
+        busy_until_ = max(busy_until_, now) + service;
+        return busy_until_;
+    }
+    
+    bool prefetchable(unsigned int pid, unsigned int vpage) const {
+        const Process& proc = process_pool[pid];
+        const PTE& pte = proc.page_table[vpage];
+        return proc.find_vma(vpage) && !pte.present && pte.paged_out && !pte.file_mapped
+            && !buffer_.count(page_key(pid, vpage));
+    }
+public:
+    unsigned long reads = 0;
+    unsigned long writes = 0;
+    unsigned long background_writes = 0;
+    unsigned long prefetched = 0;
+    unsigned long prefetch_hits = 0;
+    unsigned long long wait = 0;        /// fault-path cycles spent on the device
+    unsigned long long sync_cost = 0;   /// the same requests in the synchronous model
+    
+    SwapDevice(unsigned int window, bool writeback) :
+    window_(window),
+    writeback_(writeback),
+    busy_until_(0) {}
+    
+    /// A write made the page in frame `frame` dirty
+    void dirtied(unsigned int frame) {
+        if (writeback_) dirty_.push_back(frame);
+    }
+    
+    /// Start a background write-back if memory is full and the device idle
+    void tick(unsigned long long now) {
+        if (!writeback_ || !free_frames.empty() || busy_until_ > now) return;
+        while (!dirty_.empty()) {
+            unsigned int f = dirty_.front();
+            dirty_.pop_front();
+            if (f >= frame_table.size()) continue;
+            Frame& frame = frame_table[f];
+            PTE& pte = reversed_map(f);
+            if (!frame.mapped || frame.tail || !frame.sharers.empty() || !pte.present
+                || !pte.modified || pte.file_mapped || pte.huge) continue;
+            pte.modified = false;
+            pte.paged_out = true;
+            frame.cleaned = true;
+            background_writes++;
+            submit(now, COST_TABLE::OUTS);
+            return;
+        }
+    }
+    
+    /**
+     * Read (`pid`, `vpage`) back in on a fault, from the device buffer if it
+     * was read ahead
+     *
+     * @return the cycles the fault waits
+     */
+    unsigned long long read(unsigned int pid, unsigned int vpage, unsigned long long now) {
+        unsigned long long done;
+        sync_cost += COST_TABLE::INS;
+        auto buffered = buffer_.find(page_key(pid, vpage));
+        if (buffered != buffer_.end()) {
+            prefetch_hits++;
+            done = max(buffered->second, now);
+            buffer_.erase(buffered);
+        }
+        else {
+            reads++;
+            done = submit(now, COST_TABLE::INS);
+            for (unsigned int v = vpage + 1;
+                 v <= vpage + window_ && v < MAX_VPAGE && prefetchable(pid, v); v++) {
+                prefetched++;
+                buffer_[page_key(pid, v)] = submit(now, COST_TABLE::READ_AHEAD);
+            }
+        }
+        wait += done - now;
+        return done - now;
+    }
+    
+    /**
+     * Write a dirty victim out on the fault path
+     *
+     * @return the cycles the fault waits
+     */
+    unsigned long long write(unsigned long long now) {
+        writes++;
+        sync_cost += COST_TABLE::OUTS;
+        unsigned long long done = submit(now, COST_TABLE::OUTS);
+        wait += done - now;
+        return done - now;
+    }
+    
+    /// A victim left clean by a background write-back needs no write
+    void cleaned_eviction() {
+        sync_cost += COST_TABLE::OUTS;
+    }
+    
+    /// Drop the read-ahead pages of an exiting process
+    void exited(unsigned int pid) {
+        buffer_.erase(buffer_.lower_bound(page_key(pid, 0)),
+                      buffer_.lower_bound(page_key(pid + 1, 0)));
+    }
+};
+
+/**
+ * Interval sampling of `-i`. Every `interval` instructions the counters each
+ * process gathered per VMA since the last sample are written out and folded
+ * into its totals; only VMAs with events in the interval get a record. A VMA
+ * is named by its first vpage, -1 standing for the vpages outside any VMA.
+ *
+ * The CSV has a header line. A binary record is a `Record` in host byte order.
+ */
+class Sampler {
+private:
+    struct Record {
+        uint64_t instr;
+        uint32_t pid;
+        int32_t vma;
+        uint64_t counts[9];         /// in the order of the CSV columns
+    };
+    
+    const unsigned long interval_;
+    const bool binary_;
+    ofstream out_;
+public:
+    unsigned long next;             /// instruction count of the next sample
+    
+    Sampler(unsigned long interval, string filename, bool binary) :
+    interval_(interval),
+    binary_(binary),
+    out_(filename, binary ? ios::out | ios::binary : ios::out),
+    next(interval) {
+        if (!binary_) {
+            out_ << "instr,pid,vma,unmaps,maps,ins,outs,fins,fouts,zeros,segv,segprot\n";
+        }
+    }
+    
+    bool good() const {
+        return out_.good();
+    }
+    
+    /// Close the interval ending before instruction `instr`
+    void sample(unsigned long instr) {
+        for (size_t pid = 0; pid < process_pool.size(); pid++) {
+            Process& proc = process_pool[pid];
+            for (size_t i = 0; i < proc.counters.size(); i++) {
+                Counters& c = proc.counters[i];
+                if (c.empty()) continue;
+                Record r{instr, static_cast<uint32_t>(pid),
+                         i < proc.vmas.size() ? static_cast<int32_t>(proc.vmas[i].start_vpage) : -1,
+                         {c.unmaps, c.maps, c.ins, c.outs, c.fins, c.fouts,
+                          c.zeros, c.segv, c.segprot}};
+                if (binary_) {
+                    out_.write(reinterpret_cast<const char*>(&r), sizeof(r));
+                }
+                else {
+                    out_ << r.instr << "," << r.pid << "," << r.vma;
+                    for (uint64_t count : r.counts) {
+                        out_ << "," << count;
+                    }
+                    out_ << "\n";
+                }
+                proc.sampled += c;
+                c = Counters();
+            }
+        }
+        next = instr + interval_;
     }
 };
 
@@ -333,9 +1934,10 @@ ostream& operator << (ostream& os, const vector<PTE>& page_table) {
     for (size_t i = 0; i < page_table.size(); i++) {
         const PTE& pte = page_table[i];
         if (pte.present) {
+            const PTE& bits = pte.huge ? page_table[i - i % HUGE_PAGES] : pte;
             os << i << ":"
-               << (pte.referenced ? "R" : "-")
-               << (pte.modified ? "M" : "-")
+               << (bits.referenced ? "R" : "-")
+               << (bits.modified ? "M" : "-")
                << (pte.paged_out ? "S " : "- ");
         }
         else {
@@ -345,16 +1947,51 @@ ostream& operator << (ostream& os, const vector<PTE>& page_table) {
     return os;
 }
 
+ostream& operator << (ostream& os, const SwapDevice& swap) {
+    os << "SWAP: R=" << swap.reads
+       << " W=" << swap.writes
+       << " BW=" << swap.background_writes
+       << " RA=" << swap.prefetched
+       << " RH=" << swap.prefetch_hits
+       << " WAIT=" << swap.wait
+       << " SYNC=" << swap.sync_cost
+       << " SAVED=" << static_cast<long long>(swap.sync_cost - swap.wait);
+    return os;
+}
+
 ostream& operator << (ostream& os, const Process& process) {
-    os << " U=" << process.unmaps
-       << " M=" << process.maps
-       << " I=" << process.ins
-       << " O=" << process.outs
-       << " FI=" << process.fins
-       << " FO=" << process.fouts
-       << " Z=" << process.zeros
-       << " SV=" << process.segv
-       << " SP=" << process.segprot;
+    Counters total = process.total();
+    os << " U=" << total.unmaps
+       << " M=" << total.maps
+       << " I=" << total.ins
+       << " O=" << total.outs
+       << " FI=" << total.fins
+       << " FO=" << total.fouts
+       << " Z=" << total.zeros
+       << " SV=" << total.segv
+       << " SP=" << total.segprot;
+    if (TLB_ENTRIES) {
+        os << " TH=" << process.tlb_hits
+           << " TM=" << process.tlb_misses;
+    }
+    if (NUM_CPUS > 1) {
+        os << " SD=" << process.shootdowns;
+    }
+    if (SHARING) {
+        os << " FK=" << process.forks
+           << " CW=" << process.cow_copies
+           << " SH=" << process.shared_maps;
+    }
+    if (HUGE_PAGES > 1) {
+        os << " HM=" << process.huge_maps
+           << " HU=" << process.huge_unmaps
+           << " HZ=" << process.huge_zeros
+           << " DM=" << process.demotions;
+    }
+    if (NUMA_NODES > 1) {
+        os << " NL=" << process.local_accesses
+           << " NR=" << process.remote_accesses;
+    }
     return os;
 }
 
@@ -362,6 +1999,9 @@ class InstructionLoader {
 private:
     ifstream infile_;
     stringstream line_;
+    vector<Instruction> buffer_;    /// whole trace, only in buffered mode
+    size_t next_;
+    bool buffered_;
 
     bool get_next_valid_line() {
         string line;
@@ -374,7 +2014,7 @@ private:
         return false;
     }
 public:
-    InstructionLoader(string filename) {
+    InstructionLoader(string filename) : next_(0), buffered_(false) {
         infile_.open(filename);
     }
 
@@ -397,17 +2037,58 @@ public:
                 }
                 unsigned int start_vpage, end_vpage;
                 bool write_protected, file_mapped;
+                int file = -1;
                 line_ >> start_vpage
                       >> end_vpage
                       >> write_protected
                       >> file_mapped;
-                mmu::VMA vma{start_vpage, end_vpage, write_protected, file_mapped};
+                // optional fifth column: the shared file a mapping refers to
+                if (file_mapped && line_ >> file && file >= 0) {
+                    mmu::SHARING = true;
+                }
+                else {
+                    file = -1;
+                }
+                mmu::VMA vma{start_vpage, end_vpage, write_protected, file_mapped, file};
                 mmu::process_pool.back().vmas.push_back(vma);
             }
+            mmu::process_pool.back().index_vmas();
+        }
+    }
+
+    /**
+     * Read the rest of the trace into memory for pagers that need to look
+     * ahead. Must be called after `initialize_process`.
+     *
+     * @return every remaining instruction in trace order
+     */
+    const vector<Instruction>& buffer_instructions() {
+        char operation;
+        int vpage;
+        while (get_next_instruction(operation, vpage)) {
+            buffer_.push_back(Instruction{operation, vpage});
         }
+        buffered_ = true;
+        return buffer_;
+    }
+
+    /// Instruction of an interleaved multi-CPU trace: `<cpu> <operation> <vpage>`
+    bool get_next_instruction(unsigned int& cpu, char& operation, int& vpage) {
+        if (get_next_valid_line()) {
+            line_ >> cpu >> operation >> vpage;
+            return true;
+        }
+        return false;
     }
 
     bool get_next_instruction(char& operation, int& vpage) {
+        if (buffered_) {
+            if (next_ == buffer_.size()) return false;
+            operation = buffer_[next_].operation;
+            vpage = buffer_[next_].operand;
+            next_++;
+            return true;
+        }
         if (get_next_valid_line()) {
             line_ >> operation >> vpage;
             return true;
@@ -415,6 +2096,150 @@ public:
         return false;
     }
 };
+
+
+/// Fenwick tree over positions 1..size() that can grow one position at a time
+class Fenwick {
+private:
+    vector<int> tree_;
+public:
+    Fenwick() : tree_(1, 0) {}
+    
+    size_t size() const {
+        return tree_.size()-1;
+    }
+    
+    int prefix(size_t i) const {
+        int sum = 0;
+        for (; i > 0; i -= i & -i) sum += tree_[i];
+        return sum;
+    }
+    
+    void add(size_t i, int delta) {
+        for (; i < tree_.size(); i += i & -i) tree_[i] += delta;
+    }
+    
+    /// Append position size()+1 holding `value`
+    void push_back(int value) {
+        size_t i = tree_.size();
+        tree_.push_back(value + prefix(i-1) - prefix(i - (i & -i)));
+    }
+};
+
+/**
+ * LRU stack distances in one pass over the trace: a page's distance is the
+ * number of distinct pages touched since its previous access, i.e. the number
+ * of "latest access" marks between the two accesses. The frame pool is shared,
+ * so the miss-ratio curve comes from the global stack; per-process stacks
+ * describe each working set.
+ */
+class ReuseProfiler {
+private:
+    struct Stack {
+        Fenwick marks;                              /// 1 at each page's latest access
+        unordered_map<unsigned long, size_t> last;  /// page -> position of latest access
+        vector<unsigned long> histogram;            /// distance -> accesses
+        unsigned long cold = 0;
+        unsigned long accesses = 0;
+        unsigned long distinct = 0;
+        
+        void access(unsigned long key) {
+            accesses++;
+            marks.push_back(1);
+            size_t now = marks.size();
+            auto it = last.find(key);
+            if (it == last.end()) {
+                cold++;
+                distinct++;
+                last[key] = now;
+                return;
+            }
+            size_t distance = marks.prefix(now-1) - marks.prefix(it->second);
+            marks.add(it->second, -1);
+            it->second = now;
+            if (distance >= histogram.size()) {
+                histogram.resize(distance+1, 0);
+            }
+            histogram[distance]++;
+        }
+        
+        void forget(unsigned long key) {
+            auto it = last.find(key);
+            if (it != last.end()) {
+                marks.add(it->second, -1);
+                last.erase(it);
+            }
+        }
+    };
+    
+    vector<Stack> procs_;
+    Stack global_;
+    
+public:
+    ReuseProfiler() : procs_(process_pool.size()) {}
+    
+    void run(InstructionLoader& loader) {
+        unsigned int pid = 0;
+        char operation;
+        int operand;
+        while (loader.get_next_instruction(operation, operand)) {
+            switch (operation) {
+                case 'c':
+                    pid = operand;
+                    break;
+                case 'f': {
+                    // the child only needs the address space to check accesses
+                    Process child;
+                    child.vmas = process_pool[pid].vmas;
+                    child.vma_index = process_pool[pid].vma_index;
+                    process_pool.push_back(child);
+                    procs_.emplace_back();
+                    break;
+                }
+                case 'b':
+                    break;
+                case 'e':
+                    // an exit frees the frames, its pages no longer occupy the
+                    // stack; pages evicted earlier do not come back, so the
+                    // curve is exact only up to the first exit
+                    for (auto& page : procs_[operand].last) {
+                        global_.forget(page.first);
+                        procs_[operand].marks.add(page.second, -1);
+                    }
+                    procs_[operand].last.clear();
+                    break;
+                default:
+                    if (process_pool[pid].find_vma(operand)) {
+                        unsigned long key = page_key(pid, operand);
+                        procs_[pid].access(key);
+                        global_.access(key);
+                    }
+            }
+        }
+    }
+    
+    void print(ostream& os) {
+        for (size_t i = 0; i < procs_.size(); i++) {
+            const Stack& stack = procs_[i];
+            os << "RD[" << i << "]: WSS=" << stack.distinct
+               << " COLD=" << stack.cold << " |";
+            for (size_t d = 0; d < stack.histogram.size(); d++) {
+                if (stack.histogram[d]) os << " " << d << ":" << stack.histogram[d];
+            }
+            os << endl;
+        }
+        
+        // LRU with f frames misses every access at distance >= f
+        unsigned long misses = global_.accesses;
+        for (size_t f = 1; f <= global_.histogram.size(); f++) {
+            misses -= global_.histogram[f-1];
+            os << "MRC " << f << " " << misses << " "
+               << fixed << setprecision(4)
+               << (global_.accesses ? double(misses) / global_.accesses : 0.0)
+               << endl;
+        }
+    }
+};
 }
 
 #endif /* mmu_hpp */